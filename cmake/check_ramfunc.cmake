@@ -0,0 +1,148 @@
+# Checks that functions live in the .ramfunc region of the image, and that they do not call into flash.
+#
+# usage: cmake -DELF_FILE=<elf> -DNM=<nm> -DOBJDUMP=<objdump> -DFUNCTIONS=<name,name,...> -P check_ramfunc.cmake
+#
+# The region is delimited by the _sramfunc/_eramfunc symbols defined in firmware/linker.ld.
+#
+# * Each listed name is a demangled, qualified function name without its parameter list
+#   (e.g. FlashPageWriter::ProgramSlot). It matches the symbols (global or local) whose
+#   demangled name is exactly that, with any parameter list and clone suffix. Each name must
+#   match at least one symbol, and all matching symbols must be inside the region.
+# * The region is disassembled. Every address an instruction refers to directly (branches,
+#   literal loads) must be inside the region, and no literal word may point into the flash
+#   image [_sfixed, _etext), i.e. to a function (long calls, function pointers) or to a
+#   constant there. Calls through a register whose value is not a literal, i.e. virtual
+#   calls, can not be followed. Their targets must be listed explicitly.
+
+foreach(VARIABLE ELF_FILE NM OBJDUMP FUNCTIONS)
+    if(NOT DEFINED ${VARIABLE})
+        message(FATAL_ERROR "${VARIABLE} is not set")
+    endif()
+endforeach()
+if(NOT EXISTS "${ELF_FILE}")
+    message(FATAL_ERROR "${ELF_FILE} not found")
+endif()
+
+# Converts an address to 8 lower case hex digits without the Thumb bit, so that addresses can be compared as strings.
+function(normalize_address OUTPUT ADDRESS)
+    string(TOLOWER "${ADDRESS}" ADDRESS)
+    string(REGEX REPLACE "^0x" "" ADDRESS "${ADDRESS}")
+    string(LENGTH "${ADDRESS}" LENGTH)
+    while(LENGTH LESS 8)
+        set(ADDRESS "0${ADDRESS}")
+        math(EXPR LENGTH "${LENGTH} + 1")
+    endwhile()
+    string(REGEX MATCH "(.)$" LAST "${ADDRESS}")
+    string(REGEX REPLACE ".$" "" ADDRESS "${ADDRESS}")
+    foreach(PAIR 1:0 3:2 5:4 7:6 9:8 b:a d:c f:e)
+        string(REPLACE ":" ";" PAIR "${PAIR}")
+        list(GET PAIR 0 ODD)
+        list(GET PAIR 1 EVEN)
+        if(LAST STREQUAL ODD)
+            set(LAST "${EVEN}")
+        endif()
+    endforeach()
+    set(${OUTPUT} "${ADDRESS}${LAST}" PARENT_SCOPE)
+endfunction()
+
+execute_process(COMMAND ${NM} -C "${ELF_FILE}" OUTPUT_VARIABLE SYMBOL_TEXT RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF_FILE}")
+endif()
+string(REPLACE ";" "\\;" SYMBOL_TEXT "${SYMBOL_TEXT}")
+string(REPLACE "\n" ";" SYMBOL_LINES "${SYMBOL_TEXT}")
+
+set(RAMFUNC_START "")
+set(RAMFUNC_END "")
+set(FLASH_START "")
+set(FLASH_END "")
+foreach(LINE ${SYMBOL_LINES})
+    if(LINE MATCHES "^([0-9a-fA-F]+) [A-Za-z] _sramfunc$")
+        normalize_address(RAMFUNC_START "${CMAKE_MATCH_1}")
+    elseif(LINE MATCHES "^([0-9a-fA-F]+) [A-Za-z] _eramfunc$")
+        normalize_address(RAMFUNC_END "${CMAKE_MATCH_1}")
+    elseif(LINE MATCHES "^([0-9a-fA-F]+) [A-Za-z] _sfixed$")
+        normalize_address(FLASH_START "${CMAKE_MATCH_1}")
+    elseif(LINE MATCHES "^([0-9a-fA-F]+) [A-Za-z] _etext$")
+        normalize_address(FLASH_END "${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+if(RAMFUNC_START STREQUAL "" OR RAMFUNC_END STREQUAL "")
+    message(FATAL_ERROR "_sramfunc/_eramfunc not found in ${ELF_FILE}")
+endif()
+if(FLASH_START STREQUAL "" OR FLASH_END STREQUAL "")
+    message(FATAL_ERROR "_sfixed/_etext not found in ${ELF_FILE}")
+endif()
+
+set(ERRORS "")
+string(REPLACE "," ";" FUNCTIONS "${FUNCTIONS}")
+set(FOUND_FUNCTIONS "")
+# Addresses and names of the symbols in the flash image, to name the targets of literals.
+set(FLASH_SYMBOL_ADDRESSES "")
+set(FLASH_SYMBOL_NAMES "")
+foreach(LINE ${SYMBOL_LINES})
+    if(LINE MATCHES "^([0-9a-fA-F]+) ([A-Za-z]) (.+)$")
+        set(SYMBOL "${CMAKE_MATCH_3}")
+        normalize_address(ADDRESS "${CMAKE_MATCH_1}")
+
+        # Strip the parameter list and clone suffixes, e.g. "Foo::Bar(int) [clone .constprop.0]" -> "Foo::Bar".
+        string(REGEX REPLACE "\\(.*$" "" NAME "${SYMBOL}")
+        string(REGEX REPLACE " \\[clone .*\\]$" "" NAME "${NAME}")
+        list(FIND FUNCTIONS "${NAME}" INDEX)
+        if(NOT INDEX EQUAL -1)
+            list(APPEND FOUND_FUNCTIONS "${NAME}")
+            if(ADDRESS STRLESS RAMFUNC_START OR NOT ADDRESS STRLESS RAMFUNC_END)
+                list(APPEND ERRORS "${SYMBOL} is at ${ADDRESS}, outside of .ramfunc [${RAMFUNC_START}, ${RAMFUNC_END})")
+            endif()
+        endif()
+
+        if(NOT ADDRESS STRLESS FLASH_START AND ADDRESS STRLESS FLASH_END)
+            list(APPEND FLASH_SYMBOL_ADDRESSES "${ADDRESS}")
+            list(APPEND FLASH_SYMBOL_NAMES "${SYMBOL}")
+        endif()
+    endif()
+endforeach()
+foreach(FUNCTION ${FUNCTIONS})
+    list(FIND FOUND_FUNCTIONS "${FUNCTION}" INDEX)
+    if(INDEX EQUAL -1)
+        list(APPEND ERRORS "${FUNCTION} not found in ${ELF_FILE}")
+    endif()
+endforeach()
+
+execute_process(COMMAND ${OBJDUMP} -d -C --no-show-raw-insn --start-address=0x${RAMFUNC_START} --stop-address=0x${RAMFUNC_END} "${ELF_FILE}"
+                OUTPUT_VARIABLE DISASSEMBLY_TEXT RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${OBJDUMP} failed on ${ELF_FILE}")
+endif()
+string(REPLACE ";" "\\;" DISASSEMBLY_TEXT "${DISASSEMBLY_TEXT}")
+string(REPLACE "\n" ";" DISASSEMBLY_LINES "${DISASSEMBLY_TEXT}")
+
+set(CURRENT_FUNCTION "")
+foreach(LINE ${DISASSEMBLY_LINES})
+    if(LINE MATCHES "^[0-9a-fA-F]+ <(.+)>:$")
+        set(CURRENT_FUNCTION "${CMAKE_MATCH_1}")
+    elseif(LINE MATCHES "^ *[0-9a-fA-F]+:\t\\.word\t(0x[0-9a-fA-F]+)")
+        normalize_address(VALUE "${CMAKE_MATCH_1}")
+        if(NOT VALUE STRLESS FLASH_START AND VALUE STRLESS FLASH_END)
+            set(TARGET "flash")
+            list(FIND FLASH_SYMBOL_ADDRESSES "${VALUE}" INDEX)
+            if(NOT INDEX EQUAL -1)
+                list(GET FLASH_SYMBOL_NAMES ${INDEX} TARGET)
+            endif()
+            list(APPEND ERRORS "${CURRENT_FUNCTION} refers to ${TARGET} at ${VALUE}, outside of .ramfunc")
+        endif()
+    elseif(LINE MATCHES "^ *[0-9a-fA-F]+:\t[^\t]+\t(.*[ (])?([0-9a-fA-F]+) <([^>]+)>")
+        normalize_address(TARGET_ADDRESS "${CMAKE_MATCH_2}")
+        set(TARGET "${CMAKE_MATCH_3}")
+        if(TARGET_ADDRESS STRLESS RAMFUNC_START OR NOT TARGET_ADDRESS STRLESS RAMFUNC_END)
+            list(APPEND ERRORS "${CURRENT_FUNCTION} refers to ${TARGET} at ${TARGET_ADDRESS}, outside of .ramfunc")
+        endif()
+    endif()
+endforeach()
+
+if(ERRORS)
+    list(REMOVE_DUPLICATES ERRORS)
+    string(REPLACE ";" "\n  " ERRORS "${ERRORS}")
+    message(FATAL_ERROR "RAM function check failed:\n  ${ERRORS}")
+endif()
+message(STATUS "RAM functions are in [${RAMFUNC_START}, ${RAMFUNC_END}) and do not call into flash")
@@ -29,7 +29,12 @@
 
 #include "app.h"
 #include "definitions.h"                // SYS function prototypes
+#include "image_loader.hpp"
+#include "internal_flash.hpp"
+#include "qspi_flash.hpp"
+#include "manifest.hpp"
 #include <cstdint>
+#include <cstring>
 #include <array>
 #include <vector>
 
@@ -75,6 +80,176 @@ APP_DATA appData;
 /* TODO:  Add any necessary local functions.
 */
 
+static constexpr const std::uintptr_t APP_BASE_ADDRESS = 0x4000;
+static constexpr const std::size_t MANIFEST_MAX_SIZE = 2048;
+// How often the card is checked for removal after its image has been rejected.
+static constexpr const std::uint32_t ERROR_CARD_POLL_INTERVAL_MS = 500;
+
+// The loader executes in place from the start of the QSPI flash. Its image ends with the initial values of .relocate.
+extern "C" std::uint32_t _etext, _srelocate, _erelocate;
+
+static std::uintptr_t GetQspiFreeAreaStart()
+{
+    auto imageEnd = reinterpret_cast<std::uintptr_t>(&_etext) + (reinterpret_cast<std::uintptr_t>(&_erelocate) - reinterpret_cast<std::uintptr_t>(&_srelocate));
+    auto offset = imageEnd - QspiFlash::MemoryBase;
+    return (offset + QspiFlash::SectorSize - 1) & ~(QspiFlash::SectorSize - 1);
+}
+
+static InternalFlash internalFlash;
+static QspiFlash qspiFlash;
+static FlashPageWriter flashWriter(internalFlash, APP_BASE_ADDRESS, InternalFlash::Size);
+static FlashPageWriter qspiWriter(qspiFlash, GetQspiFreeAreaStart(), QspiFlash::Size);
+
+// Prints the outcome of loading an image on the console, and for a loaded image what programming it cost.
+// The first figure covers the whole load, i.e. reading the card and decoding as well as erasing and programming,
+// the second one only the erase and program commands.
+static bool ReportLoad(const char* path, const FlashPageWriter& writer, std::uint32_t startCycle, bool success)
+{
+    auto cycles = static_cast<unsigned long>(DWT->CYCCNT - startCycle);
+    if( !success ) {
+        SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "%s: rejected after %lu cycles\r\n", path, cycles);
+        return false;
+    }
+    auto pages = static_cast<unsigned long>(writer.GetProgrammedPageCount());
+    auto blocks = static_cast<unsigned long>(writer.GetErasedBlockCount());
+    SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "%s: %lu pages in %lu cycles (%lu cycles/page)\r\n",
+                      path, pages, cycles, pages > 0 ? cycles / pages : 0ul);
+    // What the flashing engine itself costs, i.e. the part which runs from RAM.
+    SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "%s: erase %lu cycles/block, program %lu cycles/page\r\n",
+                      path, blocks > 0 ? writer.GetEraseCycles() / blocks : 0ul, pages > 0 ? writer.GetProgramCycles() / pages : 0ul);
+    return true;
+}
+
+// Prints what verifying the last packed image cost: hashing its contents while programming, and checking the signature.
+static void ReportVerification(const char* path)
+{
+    const auto& cycles = GetImageVerificationCycles();
+    auto cyclesPerPage = cycles.hashedBytes > 0 ? static_cast<std::uint64_t>(cycles.hash) * FlashPageWriter::PageSize / cycles.hashedBytes : 0;
+    SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "%s: digest %lu cycles for %lu bytes (%lu cycles/page)\r\n",
+                      path, static_cast<unsigned long>(cycles.hash), static_cast<unsigned long>(cycles.hashedBytes), static_cast<unsigned long>(cyclesPerPage));
+    if( IMAGE_SIGNATURE_REQUIRED ) {
+        SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "%s: signature %lu cycles\r\n", path, static_cast<unsigned long>(cycles.signature));
+    }
+}
+
+static Manifest manifest;
+static ManifestBlockRange manifestBlockRanges[MANIFEST_MAX_ENTRIES];
+static char manifestText[MANIFEST_MAX_SIZE];
+static char imagePath[MANIFEST_MAX_PATH + 8];
+
+static FlashPageWriter& GetManifestWriter(const ManifestEntry& entry)
+{
+    return entry.destination == ManifestDestination::Qspi ? qspiWriter : flashWriter;
+}
+
+static SYS_FS_HANDLE OpenManifestImage(const ManifestEntry& entry)
+{
+    std::strcpy(imagePath, "/mnt/sd/");
+    std::strcat(imagePath, entry.path);
+    return SYS_FS_FileOpen(imagePath, SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+}
+
+// Programs the images listed in /mnt/sd/manifest.txt, skipping those already in flash.
+static bool LoadManifestImages(SYS_FS_HANDLE manifestHandle)
+{
+    auto length = SYS_FS_FileRead(manifestHandle, manifestText, sizeof(manifestText));
+    if( length == static_cast<decltype(length)>(-1) || length == sizeof(manifestText) ) {
+        return false;
+    }
+    if( !ParseManifest(manifestText, length, manifest) || manifest.count == 0 ) {
+        return false;
+    }
+
+    // Every writer session starts with all blocks unerased, so images sharing a block would erase each other.
+    for(std::size_t index = 0; index < manifest.count; index++) {
+        const auto& entry = manifest.entries[index];
+        auto handle = OpenManifestImage(entry);
+        if( handle == SYS_FS_HANDLE_INVALID ) {
+            return false;
+        }
+        auto& range = manifestBlockRanges[index];
+        auto success = GetPackedImageBlockRange(handle, GetManifestWriter(entry), range.begin, range.end);
+        SYS_FS_FileClose(handle);
+        if( !success ) {
+            return false;
+        }
+    }
+    if( HasOverlappingEntries(manifest, manifestBlockRanges) ) {
+        SYS_CONSOLE_Print(SYS_CONSOLE_INDEX_0, "manifest.txt: images share an erase block\r\n");
+        return false;
+    }
+
+    for(std::size_t index = 0; index < manifest.count; index++) {
+        const auto& entry = manifest.entries[index];
+        auto& writer = GetManifestWriter(entry);
+        auto expectedDigest = entry.hasDigest ? entry.digest : nullptr;
+
+        auto handle = OpenManifestImage(entry);
+        if( handle == SYS_FS_HANDLE_INVALID ) {
+            return false;
+        }
+        auto success = IsPackedImageInstalled(handle, writer, expectedDigest);
+        if( !success ) {
+            auto startCycle = DWT->CYCCNT;
+            success = SYS_FS_FileSeek(handle, 0, SYS_FS_SEEK_SET) >= 0 && LoadPackedImage(handle, writer, entry.boot, expectedDigest);
+            ReportLoad(imagePath, writer, startCycle, success);
+            ReportVerification(imagePath);
+        }
+        SYS_FS_FileClose(handle);
+        if( !success ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads the images listed in /mnt/sd/manifest.txt if it exists.
+// Otherwise loads the first image found out of /mnt/sd/app.img, /mnt/sd/app.elf, /mnt/sd/app.uf2 and /mnt/sd/app.bin.
+// The packed image is the smallest to read. It and the ELF and UF2 images only program their actual contents.
+static bool LoadApplication()
+{
+    auto handle = SYS_FS_FileOpen("/mnt/sd/manifest.txt", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+    if( handle != SYS_FS_HANDLE_INVALID ) {
+        auto success = LoadManifestImages(handle);
+        SYS_FS_FileClose(handle);
+        return success;
+    }
+    handle = SYS_FS_FileOpen("/mnt/sd/app.img", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+    if( handle != SYS_FS_HANDLE_INVALID ) {
+        auto startCycle = DWT->CYCCNT;
+        auto success = ReportLoad("/mnt/sd/app.img", flashWriter, startCycle, LoadPackedImage(handle, flashWriter, true));
+        ReportVerification("/mnt/sd/app.img");
+        SYS_FS_FileClose(handle);
+        return success;
+    }
+    // ELF, UF2 and raw binary images carry no signature.
+    if( IMAGE_SIGNATURE_REQUIRED ) {
+        return false;
+    }
+    handle = SYS_FS_FileOpen("/mnt/sd/app.elf", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+    if( handle != SYS_FS_HANDLE_INVALID ) {
+        auto startCycle = DWT->CYCCNT;
+        auto success = ReportLoad("/mnt/sd/app.elf", flashWriter, startCycle, LoadElfImage(handle, flashWriter));
+        SYS_FS_FileClose(handle);
+        return success;
+    }
+    handle = SYS_FS_FileOpen("/mnt/sd/app.uf2", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+    if( handle != SYS_FS_HANDLE_INVALID ) {
+        auto startCycle = DWT->CYCCNT;
+        auto success = ReportLoad("/mnt/sd/app.uf2", flashWriter, startCycle, LoadUf2Image(handle, flashWriter));
+        SYS_FS_FileClose(handle);
+        return success;
+    }
+    handle = SYS_FS_FileOpen("/mnt/sd/app.bin", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
+    if( handle != SYS_FS_HANDLE_INVALID ) {
+        auto startCycle = DWT->CYCCNT;
+        auto success = ReportLoad("/mnt/sd/app.bin", flashWriter, startCycle, LoadBinaryImage(handle, flashWriter, APP_BASE_ADDRESS));
+        SYS_FS_FileClose(handle);
+        return success;
+    }
+    return false;
+}
+
 
 // *****************************************************************************
 // *****************************************************************************
@@ -103,8 +278,14 @@ void APP_Initialize ( void )
 {
     transferQueue = xQueueCreate(16, sizeof(DRV_SPI_TRANSFER_HANDLE));
 
+    // The cycle counter measures the image loads (see ReportLoad()).
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     /* Place the App state machine in its initial state. */
     appData.state = APP_STATE_INIT;
+    appData.lcdState = APP_LCD_STATE_RESET;
     spiHandle = DRV_SPI_Open(sysObj.drvSPI0, static_cast<DRV_IO_INTENT>(DRV_IO_INTENT_BLOCKING | DRV_IO_INTENT_EXCLUSIVE | DRV_IO_INTENT_READWRITE));
     // DRV_SPI_TRANSFER_SETUP setup;
     // setup.chipSelect = SYS_PORT_PIN_NONE;
@@ -252,47 +433,6 @@ static constexpr const std::uint8_t ILI9341_MADCTL_RGB = 0x00;
 static constexpr const std::uint8_t ILI9341_MADCTL_BGR = 0x08;
 static constexpr const std::uint8_t ILI9341_MADCTL_MH = 0x04;
 
-static void ResetLcd()
-{
-    FSYNC_OUT_Clear();
-    FSYNC_OUT_OutputEnable();
-
-    LCD_CS_Set();
-    LCD_RESET_Clear();
-    vTaskDelay(pdMS_TO_TICKS(150));
-    LCD_RESET_Set();
-    vTaskDelay(pdMS_TO_TICKS(150));
-    
-    LCD_CS_Clear();
-    WriteLcdCommandData<3>(0xef, {0x03, 0x80, 0x02});
-    WriteLcdCommandData<3>(0xcf, {0x00, 0xc1, 0x30});
-    WriteLcdCommandData<4>(0xed, {0x64, 0x03, 0x12, 0x81});
-    WriteLcdCommandData<3>(0xe8, {0x85, 0x00, 0x78});
-    WriteLcdCommandData<5>(0xcb, {0x39, 0x2c, 0x00, 0x34, 0x02});
-    WriteLcdCommandData<1>(0xf7, {0x20});
-    WriteLcdCommandData<2>(0xea, {0x00, 0x00});
-    WriteLcdCommandData<1>(ILI9341_PWCTR1, {0x23});
-    WriteLcdCommandData<1>(ILI9341_PWCTR2, {0x10});
-    WriteLcdCommandData<2>(ILI9341_VMCTR1, {0x3e, 0x28});
-    WriteLcdCommandData<1>(ILI9341_VMCTR2, {0x86});
-    WriteLcdCommandData<1>(ILI9341_MADCTL, {0xa8});
-    WriteLcdCommandData<1>(ILI9341_PIXFMT, {0x55});
-    WriteLcdCommandData<2>(ILI9341_FRMCTR1, {0x00, 0x13});
-    WriteLcdCommandData<3>(ILI9341_DFUNCTR, {0x08, 0x82, 0x27});
-    WriteLcdCommandData<1>(0xf2, {0x00});
-    WriteLcdCommandData<1>(ILI9341_GAMMASET, {0x01});
-    WriteLcdCommandData<15>(ILI9341_GMCTRP1, {0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, 0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00});
-    WriteLcdCommandData<15>(ILI9341_GMCTRN1, {0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, 0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F});
-    WriteLcdCommand(ILI9341_SLPOUT);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    WriteLcdCommand(ILI9341_DISPON);
-    WriteLcdCommandData<1>(TFT_MADCTL, {TFT_MAD_BGR | 0xe0});
-    LCD_CS_Set();
-
-    LCD_BACKLIGHT_CTR_OutputEnable();
-    TC0_CompareStart();
-}
-
 static void SetLcdColumnAddress(std::uint_fast16_t start, std::uint_fast16_t end)
 {
     std::array<std::uint8_t, 4> buffer = {
@@ -353,6 +493,91 @@ static void FillLcd(std::uint_fast16_t x0, std::uint_fast16_t y0, std::uint_fast
     }
     LCD_CS_Set();
 }
+static void StartLcdWait(std::uint32_t milliseconds)
+{
+    appData.lcdWaitStart = xTaskGetTickCount();
+    appData.lcdWaitTicks = pdMS_TO_TICKS(milliseconds);
+}
+
+static bool IsLcdWaitElapsed()
+{
+    return static_cast<TickType_t>(xTaskGetTickCount() - appData.lcdWaitStart) >= appData.lcdWaitTicks;
+}
+
+// Advances the LCD initialization sequence without blocking and returns whether the LCD is ready.
+// The reset and sleep out waits of the ILI9341 take 800 ms in total, so this is called repeatedly
+// from APP_Tasks while the SD card is being mounted, and from the image loaders between their file
+// reads while the images are being checked and loaded (see SetImageLoadIdleHandler()).
+static bool StepLcdInitialization()
+{
+    switch( appData.lcdState )
+    {
+        case APP_LCD_STATE_RESET:
+            FSYNC_OUT_Clear();
+            FSYNC_OUT_OutputEnable();
+
+            LCD_CS_Set();
+            LCD_RESET_Clear();
+            StartLcdWait(150);
+            appData.lcdState = APP_LCD_STATE_WAIT_RESET;
+            break;
+
+        case APP_LCD_STATE_WAIT_RESET:
+            if( IsLcdWaitElapsed() ) {
+                LCD_RESET_Set();
+                StartLcdWait(150);
+                appData.lcdState = APP_LCD_STATE_WAIT_RESET_RECOVERY;
+            }
+            break;
+
+        case APP_LCD_STATE_WAIT_RESET_RECOVERY:
+            if( IsLcdWaitElapsed() ) {
+                LCD_CS_Clear();
+                WriteLcdCommandData<3>(0xef, {0x03, 0x80, 0x02});
+                WriteLcdCommandData<3>(0xcf, {0x00, 0xc1, 0x30});
+                WriteLcdCommandData<4>(0xed, {0x64, 0x03, 0x12, 0x81});
+                WriteLcdCommandData<3>(0xe8, {0x85, 0x00, 0x78});
+                WriteLcdCommandData<5>(0xcb, {0x39, 0x2c, 0x00, 0x34, 0x02});
+                WriteLcdCommandData<1>(0xf7, {0x20});
+                WriteLcdCommandData<2>(0xea, {0x00, 0x00});
+                WriteLcdCommandData<1>(ILI9341_PWCTR1, {0x23});
+                WriteLcdCommandData<1>(ILI9341_PWCTR2, {0x10});
+                WriteLcdCommandData<2>(ILI9341_VMCTR1, {0x3e, 0x28});
+                WriteLcdCommandData<1>(ILI9341_VMCTR2, {0x86});
+                WriteLcdCommandData<1>(ILI9341_MADCTL, {0xa8});
+                WriteLcdCommandData<1>(ILI9341_PIXFMT, {0x55});
+                WriteLcdCommandData<2>(ILI9341_FRMCTR1, {0x00, 0x13});
+                WriteLcdCommandData<3>(ILI9341_DFUNCTR, {0x08, 0x82, 0x27});
+                WriteLcdCommandData<1>(0xf2, {0x00});
+                WriteLcdCommandData<1>(ILI9341_GAMMASET, {0x01});
+                WriteLcdCommandData<15>(ILI9341_GMCTRP1, {0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, 0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00});
+                WriteLcdCommandData<15>(ILI9341_GMCTRN1, {0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, 0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F});
+                WriteLcdCommand(ILI9341_SLPOUT);
+                StartLcdWait(500);
+                appData.lcdState = APP_LCD_STATE_WAIT_SLEEP_OUT;
+            }
+            break;
+
+        case APP_LCD_STATE_WAIT_SLEEP_OUT:
+            if( IsLcdWaitElapsed() ) {
+                WriteLcdCommand(ILI9341_DISPON);
+                WriteLcdCommandData<1>(TFT_MADCTL, {TFT_MAD_BGR | 0xe0});
+                LCD_CS_Set();
+
+                LCD_BACKLIGHT_CTR_OutputEnable();
+                TC0_CompareStart();
+                FillLcd(0, 0, 320, 240, 0);
+                appData.lcdState = APP_LCD_STATE_READY;
+            }
+            break;
+
+        case APP_LCD_STATE_READY:
+        default:
+            break;
+    }
+    return appData.lcdState == APP_LCD_STATE_READY;
+}
+
 /******************************************************************************
   Function:
     void APP_Tasks ( void )
@@ -376,9 +601,9 @@ void APP_Tasks ( void )
         {
             bool appInitialized = true;
 
-            ResetLcd();
-            FillLcd(0, 0, 320, 240, 0);
+            // The LCD is brought up by StepLcdInitialization() in the following states, and during the image loads.
             NVMCTRL_Initialize();
+            SetImageLoadIdleHandler([]() { StepLcdInitialization(); });
             if (appInitialized)
             {
                 appData.state = APP_STATE_SERVICE_TASKS;
@@ -388,69 +613,76 @@ void APP_Tasks ( void )
 
         case APP_STATE_SERVICE_TASKS:
         {
-            TC0_Compare8bitMatch0Set(backlightOutput);
-            backlightOutput += 1;
-
-            if( backlightOutput > 100 ) {
-                backlightOutput = 0;
-            }
             USER_LED_Toggle();
-            FSYNC_OUT_Set();
-            switch(color)
-            {
-                case 0: FillLcd(0, 0, 320, 240, 0x1f << 11); break;
-                case 1: FillLcd(0, 0, 320, 240, 0x3f << 5); break;
-                case 2: FillLcd(0, 0, 320, 240, 0x1f << 0); break;
-                case 3: FillLcd(0, 0, 320, 240, 0); break;
+            // Mounting the card and loading the image do not wait for the LCD.
+            if( StepLcdInitialization() ) {
+                TC0_Compare8bitMatch0Set(backlightOutput);
+                backlightOutput += 1;
+
+                if( backlightOutput > 100 ) {
+                    backlightOutput = 0;
+                }
+                FSYNC_OUT_Set();
+                switch(color)
+                {
+                    case 0: FillLcd(0, 0, 320, 240, 0x1f << 11); break;
+                    case 1: FillLcd(0, 0, 320, 240, 0x3f << 5); break;
+                    case 2: FillLcd(0, 0, 320, 240, 0x1f << 0); break;
+                    case 3: FillLcd(0, 0, 320, 240, 0); break;
+                }
+                //color = (color + 1) & 3;
+                FSYNC_OUT_Clear();
             }
-            //color = (color + 1) & 3;
-            FSYNC_OUT_Clear();
-            bool success = false;
             if( SYS_FS_Mount("/dev/mmcblka1", "/mnt/sd", SYS_FS_FILE_SYSTEM_TYPE::FAT, 0, nullptr) == SYS_FS_RES_SUCCESS ) {
-                auto handle = SYS_FS_FileOpen("/mnt/sd/app.bin", SYS_FS_FILE_OPEN_ATTRIBUTES::SYS_FS_FILE_OPEN_READ);
-                if( handle != SYS_FS_HANDLE_INVALID ) {
-                    std::uint32_t pageBuffer[NVMCTRL_FLASH_PAGESIZE/4];
-                    auto fileSize = SYS_FS_FileSize(handle);
-                    std::uintptr_t baseAddress = 0x4000;
-                    if( fileSize > 0 ) {
-                        for(std::uintptr_t bytesWritten = 0; bytesWritten < fileSize; bytesWritten += NVMCTRL_FLASH_PAGESIZE) {
-                            if( (bytesWritten & (NVMCTRL_FLASH_BLOCKSIZE-1)) == 0 ) {
-                                // Erase block
-                                NVMCTRL_BlockErase(bytesWritten + baseAddress);
-                                while(NVMCTRL_IsBusy());
-                            }
-                            auto bytesToRead = fileSize - bytesWritten;
-                            bytesToRead = bytesToRead > NVMCTRL_FLASH_PAGESIZE ? NVMCTRL_FLASH_PAGESIZE : bytesToRead;
-                            SYS_FS_FileRead(handle, pageBuffer, bytesToRead);
-                            memset(reinterpret_cast<std::uint8_t*>(pageBuffer) + bytesToRead, 0xff, NVMCTRL_FLASH_PAGESIZE - bytesToRead);
-                            NVMCTRL_PageWrite(pageBuffer, baseAddress+bytesWritten);
-                            while(NVMCTRL_IsBusy());
-                        }
-                        SYS_FS_FileClose(handle);
-                        success = true;
-                    }
-                }
-                SYS_FS_Unmount("/sd");
+                auto success = LoadApplication();
+                SYS_FS_Unmount("/mnt/sd");
+                // A rejected image may have been partly programmed already. Loading it again would only
+                // erase and program the flash over and over, so wait for the card to be changed instead.
+                appData.state = success ? APP_STATE_END : APP_STATE_ERROR;
             }
-
-            if(success) {
-                appData.state = APP_STATE_END;
+            else {
+                // The task delay of the generated RTOS task is disabled, and nothing above blocks while the card
+                // is not mounted and the LCD is still waiting. Yield so that the SD card driver, the file system
+                // and other lower priority tasks can run.
+                vTaskDelay(1);
             }
 
             
             break;
         }
+        case APP_STATE_ERROR:
+            USER_LED_Toggle();
+            if( StepLcdInitialization() ) {
+                FSYNC_OUT_Set();
+                FillLcd(0, 0, 320, 240, (0x1f << 11) | (0x3f << 5));
+                FSYNC_OUT_Clear();
+            }
+            // The card can not be mounted once it has been removed. Then the next card is loaded.
+            if( SYS_FS_Mount("/dev/mmcblka1", "/mnt/sd", SYS_FS_FILE_SYSTEM_TYPE::FAT, 0, nullptr) == SYS_FS_RES_SUCCESS ) {
+                SYS_FS_Unmount("/mnt/sd");
+            }
+            else {
+                appData.state = APP_STATE_SERVICE_TASKS;
+            }
+            vTaskDelay(pdMS_TO_TICKS(ERROR_CARD_POLL_INTERVAL_MS));
+            break;
         case APP_STATE_END:
-            TC0_Compare8bitMatch0Set(backlightOutput);
-            backlightOutput += 1;
+            USER_LED_Toggle();
+            if( StepLcdInitialization() ) {
+                TC0_Compare8bitMatch0Set(backlightOutput);
+                backlightOutput += 1;
 
-            if( backlightOutput > 100 ) {
-                backlightOutput = 0;
+                if( backlightOutput > 100 ) {
+                    backlightOutput = 0;
+                }
+                FSYNC_OUT_Set();
+                FillLcd(0, 0, 320, 240, 0x3f << 5);
+                FSYNC_OUT_Clear();
+            }
+            else {
+                // Nothing else blocks in this state until the LCD is ready.
+                vTaskDelay(1);
             }
-            USER_LED_Toggle();
-            FSYNC_OUT_Set();
-            FillLcd(0, 0, 320, 240, 0x3f << 5);
-            FSYNC_OUT_Clear();
             break;
         
         /* The default state should never be executed. */
@@ -66,11 +66,42 @@ typedef enum
     APP_STATE_INIT=0,
     APP_STATE_SERVICE_TASKS,
     APP_STATE_END,
+    /* The image on the card was rejected. Waiting for the card to be removed. */
+    APP_STATE_ERROR,
     /* TODO: Define states used by the application state machine. */
 
 } APP_STATES;
 
 
+// *****************************************************************************
+/* LCD initialization states
+
+  Summary:
+    LCD initialization sequence states enumeration
+
+  Description:
+    This enumeration defines the steps of the LCD initialization sequence.
+    The sequence is advanced from the application's state machine without
+    blocking, so the reset and sleep out waits of the LCD controller overlap
+    with mounting the SD card and loading the image.
+*/
+
+typedef enum
+{
+    /* Assert the reset of the LCD controller. */
+    APP_LCD_STATE_RESET=0,
+    /* Waiting with the reset asserted. */
+    APP_LCD_STATE_WAIT_RESET,
+    /* Waiting for the controller to come out of reset. */
+    APP_LCD_STATE_WAIT_RESET_RECOVERY,
+    /* Configured and waiting for the controller to exit sleep mode. */
+    APP_LCD_STATE_WAIT_SLEEP_OUT,
+    /* The LCD is ready to draw. */
+    APP_LCD_STATE_READY,
+
+} APP_LCD_STATES;
+
+
 // *****************************************************************************
 /* Application Data
 
@@ -89,6 +120,13 @@ typedef struct
     /* The application's current state */
     APP_STATES state;
 
+    /* The current step of the LCD initialization sequence */
+    APP_LCD_STATES lcdState;
+
+    /* The tick count when the current LCD wait started and its length */
+    TickType_t lcdWaitStart;
+    TickType_t lcdWaitTicks;
+
     /* TODO: Define any additional data used by the application. */
 
 } APP_DATA;
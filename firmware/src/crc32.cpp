@@ -0,0 +1,40 @@
+/*******************************************************************************
+  CRC-32
+
+  File Name:
+    crc32.cpp
+
+  Summary:
+    CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320), as used by zlib.
+ *******************************************************************************/
+
+#include "crc32.hpp"
+
+struct Crc32Table
+{
+    std::uint32_t entries[256];
+
+    constexpr Crc32Table() : entries()
+    {
+        for(std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t value = i;
+            for(int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[i] = value;
+        }
+    }
+};
+
+// Not const, so that the table is placed in .data and looked up from RAM like the code using it.
+static Crc32Table crc32Table;
+
+std::uint32_t Crc32Update(std::uint32_t crc, const void* data, std::size_t length)
+{
+    auto bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+    for(std::size_t i = 0; i < length; i++) {
+        crc = crc32Table.entries[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,24 @@
+/*******************************************************************************
+  CRC-32
+
+  File Name:
+    crc32.hpp
+
+  Summary:
+    CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320), as used by zlib.
+
+  Description:
+    Shared by the firmware and the host side packer.
+ *******************************************************************************/
+
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "ramfunc.hpp"
+
+/* Continues a CRC-32 computation. Pass 0 as crc for the first call. */
+RAMFUNC std::uint32_t Crc32Update(std::uint32_t crc, const void* data, std::size_t length);
+
+#endif //CRC32_HPP
@@ -0,0 +1,471 @@
+/*******************************************************************************
+  Ed25519 signatures
+
+  File Name:
+    ed25519.cpp
+
+  Summary:
+    Ed25519 signature verification (RFC 8032), and signing for the host.
+
+  Description:
+    The arithmetic follows the structure of TweetNaCl. An element of
+    GF(2^255 - 19) is sixteen limbs of 16 bits, kept in 64 bit integers so
+    that products can be accumulated before carrying. Points are in extended
+    twisted Edwards coordinates (X, Y, Z, T).
+
+    Verification computes [S]B - [k]A with one shared doubling chain
+    (Straus/Shamir), about 256 doublings and 190 additions. Signing uses a
+    constant time ladder instead, since its scalars are secret.
+
+    Points and field elements are large (512 and 128 bytes). On the stack,
+    verification would need about 5 KiB, more than the 4 KiB stack of the
+    application task. The points, the temporaries of the point functions and
+    the wide scalar are therefore static. The deepest path left is hashing
+    with SHA-512, about 1.2 KiB with -fstack-usage on the host. None of the
+    functions is reentrant.
+ *******************************************************************************/
+
+#include "ed25519.hpp"
+#include "sha512.hpp"
+#include <cstring>
+
+struct FieldElement
+{
+    std::int64_t limbs[16];
+};
+
+struct Point
+{
+    FieldElement x;
+    FieldElement y;
+    FieldElement z;
+    FieldElement t;
+};
+
+static constexpr const FieldElement FIELD_ZERO = {{0}};
+static constexpr const FieldElement FIELD_ONE = {{1}};
+// Curve constant d = -121665/121666
+static constexpr const FieldElement CURVE_D = {{0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203}};
+// 2 * d
+static constexpr const FieldElement CURVE_D2 = {{0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406}};
+// Coordinates of the base point
+static constexpr const FieldElement BASE_X = {{0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169}};
+static constexpr const FieldElement BASE_Y = {{0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666}};
+// sqrt(-1)
+static constexpr const FieldElement SQRT_M1 = {{0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83}};
+// Group order L = 2^252 + 27742317777372353535851937790883648493, little endian
+static constexpr const std::uint8_t GROUP_ORDER[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+};
+
+static void Carry(FieldElement& value)
+{
+    for(int i = 0; i < 16; i++) {
+        value.limbs[i] += static_cast<std::int64_t>(1) << 16;
+        auto carry = value.limbs[i] >> 16;
+        // The carry out of the top limb wraps around multiplied by 38, since 2^256 = 38 (mod p).
+        if( i < 15 ) {
+            value.limbs[i + 1] += carry - 1;
+        }
+        else {
+            value.limbs[0] += 38 * (carry - 1);
+        }
+        value.limbs[i] -= carry << 16;
+    }
+}
+
+// Swaps p and q if swap is 1, without branching on it.
+static void Select(FieldElement& p, FieldElement& q, int swap)
+{
+    auto mask = ~static_cast<std::int64_t>(swap - 1);
+    for(int i = 0; i < 16; i++) {
+        auto t = mask & (p.limbs[i] ^ q.limbs[i]);
+        p.limbs[i] ^= t;
+        q.limbs[i] ^= t;
+    }
+}
+
+// Encodes the fully reduced value in 32 little endian bytes.
+static void Pack(std::uint8_t* output, const FieldElement& value)
+{
+    auto t = value;
+    Carry(t);
+    Carry(t);
+    Carry(t);
+    for(int j = 0; j < 2; j++) {
+        FieldElement m;
+        m.limbs[0] = t.limbs[0] - 0xffed;
+        for(int i = 1; i < 15; i++) {
+            m.limbs[i] = t.limbs[i] - 0xffff - ((m.limbs[i - 1] >> 16) & 1);
+            m.limbs[i - 1] &= 0xffff;
+        }
+        m.limbs[15] = t.limbs[15] - 0x7fff - ((m.limbs[14] >> 16) & 1);
+        auto borrow = static_cast<int>((m.limbs[15] >> 16) & 1);
+        m.limbs[14] &= 0xffff;
+        Select(t, m, 1 - borrow);
+    }
+    for(int i = 0; i < 16; i++) {
+        output[2*i + 0] = static_cast<std::uint8_t>(t.limbs[i]);
+        output[2*i + 1] = static_cast<std::uint8_t>(t.limbs[i] >> 8);
+    }
+}
+
+static void Unpack(FieldElement& output, const std::uint8_t* input)
+{
+    for(int i = 0; i < 16; i++) {
+        output.limbs[i] = input[2*i] + (static_cast<std::int64_t>(input[2*i + 1]) << 8);
+    }
+    output.limbs[15] &= 0x7fff;
+}
+
+static bool IsEqual(const FieldElement& a, const FieldElement& b)
+{
+    std::uint8_t packedA[32];
+    std::uint8_t packedB[32];
+    Pack(packedA, a);
+    Pack(packedB, b);
+    return std::memcmp(packedA, packedB, sizeof(packedA)) == 0;
+}
+
+static int Parity(const FieldElement& value)
+{
+    std::uint8_t packed[32];
+    Pack(packed, value);
+    return packed[0] & 1;
+}
+
+static void Add(FieldElement& output, const FieldElement& a, const FieldElement& b)
+{
+    for(int i = 0; i < 16; i++) {
+        output.limbs[i] = a.limbs[i] + b.limbs[i];
+    }
+}
+
+static void Subtract(FieldElement& output, const FieldElement& a, const FieldElement& b)
+{
+    for(int i = 0; i < 16; i++) {
+        output.limbs[i] = a.limbs[i] - b.limbs[i];
+    }
+}
+
+// The limbs of the operands stay below 2^20 in magnitude, so 32 x 32 -> 64 bit products
+// are sufficient. This lets the compiler use a single SMLAL per product on Cortex-M4.
+static void Multiply(FieldElement& output, const FieldElement& a, const FieldElement& b)
+{
+    std::int64_t t[31] = {};
+    for(int i = 0; i < 16; i++) {
+        auto ai = static_cast<std::int32_t>(a.limbs[i]);
+        for(int j = 0; j < 16; j++) {
+            t[i + j] += static_cast<std::int64_t>(ai) * static_cast<std::int32_t>(b.limbs[j]);
+        }
+    }
+    for(int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    for(int i = 0; i < 16; i++) {
+        output.limbs[i] = t[i];
+    }
+    Carry(output);
+    Carry(output);
+}
+
+static void Square(FieldElement& output, const FieldElement& a)
+{
+    Multiply(output, a, a);
+}
+
+// a^(p - 2)
+static void Invert(FieldElement& output, const FieldElement& a)
+{
+    auto c = a;
+    for(int i = 253; i >= 0; i--) {
+        Square(c, c);
+        if( i != 2 && i != 4 ) {
+            Multiply(c, c, a);
+        }
+    }
+    output = c;
+}
+
+// a^((p - 5) / 8)
+static void Power2523(FieldElement& output, const FieldElement& a)
+{
+    auto c = a;
+    for(int i = 250; i >= 0; i--) {
+        Square(c, c);
+        if( i != 1 ) {
+            Multiply(c, c, a);
+        }
+    }
+    output = c;
+}
+
+// p += q
+static void AddPoint(Point& p, const Point& q)
+{
+    static FieldElement a, b, c, d, t, e, f, g, h;
+    Subtract(a, p.y, p.x);
+    Subtract(t, q.y, q.x);
+    Multiply(a, a, t);
+    Add(b, p.x, p.y);
+    Add(t, q.x, q.y);
+    Multiply(b, b, t);
+    Multiply(c, p.t, q.t);
+    Multiply(c, c, CURVE_D2);
+    Multiply(d, p.z, q.z);
+    Add(d, d, d);
+    Subtract(e, b, a);
+    Subtract(f, d, c);
+    Add(g, d, c);
+    Add(h, b, a);
+    Multiply(p.x, e, f);
+    Multiply(p.y, h, g);
+    Multiply(p.z, g, f);
+    Multiply(p.t, e, h);
+}
+
+static void PackPoint(std::uint8_t* output, const Point& p)
+{
+    static FieldElement zInverse, x, y;
+    Invert(zInverse, p.z);
+    Multiply(x, p.x, zInverse);
+    Multiply(y, p.y, zInverse);
+    Pack(output, y);
+    output[31] ^= Parity(x) << 7;
+}
+
+// output = [s]B + [k]a. Used for verification only: the run time depends on the scalars, which are public there.
+static void DoubleScalarMultiplyBase(Point& output, const std::uint8_t* s, const std::uint8_t* k, const Point& a)
+{
+    // table[n - 1] is the point added for the bit pair n = sBit | kBit << 1.
+    static Point table[3];
+    table[0].x = BASE_X;
+    table[0].y = BASE_Y;
+    table[0].z = FIELD_ONE;
+    Multiply(table[0].t, BASE_X, BASE_Y);
+    table[1] = a;
+    table[2] = table[0];
+    AddPoint(table[2], a);
+
+    output.x = FIELD_ZERO;
+    output.y = FIELD_ONE;
+    output.z = FIELD_ONE;
+    output.t = FIELD_ZERO;
+    for(int i = 255; i >= 0; i--) {
+        AddPoint(output, output);
+        auto index = ((s[i/8] >> (i & 7)) & 1) | (((k[i/8] >> (i & 7)) & 1) << 1);
+        if( index != 0 ) {
+            AddPoint(output, table[index - 1]);
+        }
+    }
+}
+
+// Decodes a point and negates it. Returns false if the encoding is not a point on the curve.
+static bool UnpackNegatedPoint(Point& output, const std::uint8_t* input)
+{
+    static FieldElement t, check, numerator, denominator, denominator2, denominator4, denominator6;
+    output.z = FIELD_ONE;
+    Unpack(output.y, input);
+    Square(numerator, output.y);
+    Multiply(denominator, numerator, CURVE_D);
+    Subtract(numerator, numerator, output.z);
+    Add(denominator, output.z, denominator);
+
+    // x = sqrt(u / v) computed as u * v^3 * (u * v^7)^((p - 5) / 8)
+    Square(denominator2, denominator);
+    Square(denominator4, denominator2);
+    Multiply(denominator6, denominator4, denominator2);
+    Multiply(t, denominator6, numerator);
+    Multiply(t, t, denominator);
+    Power2523(t, t);
+    Multiply(t, t, numerator);
+    Multiply(t, t, denominator);
+    Multiply(t, t, denominator);
+    Multiply(output.x, t, denominator);
+
+    Square(check, output.x);
+    Multiply(check, check, denominator);
+    if( !IsEqual(check, numerator) ) {
+        Multiply(output.x, output.x, SQRT_M1);
+    }
+    Square(check, output.x);
+    Multiply(check, check, denominator);
+    if( !IsEqual(check, numerator) ) {
+        return false;
+    }
+
+    if( Parity(output.x) == (input[31] >> 7) ) {
+        Subtract(output.x, FIELD_ZERO, output.x);
+    }
+    Multiply(output.t, output.x, output.y);
+    return true;
+}
+
+// output = x mod L, where x holds 64 limbs of 8 bits. x is clobbered.
+static void ReduceModL(std::uint8_t* output, std::int64_t* x)
+{
+    for(int i = 63; i >= 32; i--) {
+        std::int64_t carry = 0;
+        int j;
+        for(j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * GROUP_ORDER[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    std::int64_t carry = 0;
+    for(int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * GROUP_ORDER[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for(int j = 0; j < 32; j++) {
+        x[j] -= carry * GROUP_ORDER[j];
+    }
+    for(int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        output[i] = static_cast<std::uint8_t>(x[i] & 255);
+    }
+}
+
+// Reduces a 64 byte hash modulo L into its first 32 bytes.
+static void ReduceHash(std::uint8_t* hash)
+{
+    static std::int64_t x[64];
+    for(int i = 0; i < 64; i++) {
+        x[i] = hash[i];
+    }
+    ReduceModL(hash, x);
+}
+
+// Checks s < L, as required for a canonical signature.
+static bool IsCanonicalScalar(const std::uint8_t* s)
+{
+    for(int i = 31; i >= 0; i--) {
+        if( s[i] != GROUP_ORDER[i] ) {
+            return s[i] < GROUP_ORDER[i];
+        }
+    }
+    return false;
+}
+
+bool Ed25519Verify(const std::uint8_t* signature, const void* message, std::size_t length, const std::uint8_t* publicKey)
+{
+    static Point negatedA;
+    static Point p;
+    if( !IsCanonicalScalar(signature + 32) || !UnpackNegatedPoint(negatedA, publicKey) ) {
+        return false;
+    }
+
+    // k = SHA-512(R || A || M) mod L
+    std::uint8_t k[Sha512::DigestSize];
+    Sha512 sha;
+    sha.Update(signature, 32);
+    sha.Update(publicKey, ED25519_PUBLIC_KEY_SIZE);
+    sha.Update(message, length);
+    sha.Final(k);
+    ReduceHash(k);
+
+    // The signature is valid if [S]B - [k]A encodes to R.
+    DoubleScalarMultiplyBase(p, signature + 32, k, negatedA);
+    std::uint8_t r[32];
+    PackPoint(r, p);
+    return std::memcmp(r, signature, sizeof(r)) == 0;
+}
+
+#if !defined(__arm__)
+static void SelectPoint(Point& p, Point& q, int swap)
+{
+    Select(p.x, q.x, swap);
+    Select(p.y, q.y, swap);
+    Select(p.z, q.z, swap);
+    Select(p.t, q.t, swap);
+}
+
+// output = scalar * q in constant time. q is clobbered.
+static void ScalarMultiply(Point& output, Point& q, const std::uint8_t* scalar)
+{
+    output.x = FIELD_ZERO;
+    output.y = FIELD_ONE;
+    output.z = FIELD_ONE;
+    output.t = FIELD_ZERO;
+    for(int i = 255; i >= 0; i--) {
+        auto bit = (scalar[i/8] >> (i & 7)) & 1;
+        SelectPoint(output, q, bit);
+        AddPoint(q, output);
+        AddPoint(output, output);
+        SelectPoint(output, q, bit);
+    }
+}
+
+static void ScalarMultiplyBase(Point& output, const std::uint8_t* scalar)
+{
+    Point q;
+    q.x = BASE_X;
+    q.y = BASE_Y;
+    q.z = FIELD_ONE;
+    Multiply(q.t, BASE_X, BASE_Y);
+    ScalarMultiply(output, q, scalar);
+}
+
+// Expands the secret key into the clamped scalar (first half) and the nonce prefix (second half).
+static void ExpandSecretKey(std::uint8_t* expanded, const std::uint8_t* secretKey)
+{
+    Sha512 sha;
+    sha.Update(secretKey, ED25519_SECRET_KEY_SIZE);
+    sha.Final(expanded);
+    expanded[0] &= 248;
+    expanded[31] &= 127;
+    expanded[31] |= 64;
+}
+
+void Ed25519GetPublicKey(std::uint8_t* publicKey, const std::uint8_t* secretKey)
+{
+    std::uint8_t expanded[Sha512::DigestSize];
+    ExpandSecretKey(expanded, secretKey);
+    Point p;
+    ScalarMultiplyBase(p, expanded);
+    PackPoint(publicKey, p);
+}
+
+void Ed25519Sign(std::uint8_t* signature, const void* message, std::size_t length, const std::uint8_t* secretKey)
+{
+    std::uint8_t expanded[Sha512::DigestSize];
+    ExpandSecretKey(expanded, secretKey);
+    std::uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+    Ed25519GetPublicKey(publicKey, secretKey);
+
+    // r = SHA-512(prefix || M) mod L, R = [r]B
+    std::uint8_t r[Sha512::DigestSize];
+    Sha512 sha;
+    sha.Update(expanded + 32, 32);
+    sha.Update(message, length);
+    sha.Final(r);
+    ReduceHash(r);
+    Point p;
+    ScalarMultiplyBase(p, r);
+    PackPoint(signature, p);
+
+    // S = (r + k * s) mod L
+    std::uint8_t k[Sha512::DigestSize];
+    sha.Reset();
+    sha.Update(signature, 32);
+    sha.Update(publicKey, sizeof(publicKey));
+    sha.Update(message, length);
+    sha.Final(k);
+    ReduceHash(k);
+    std::int64_t x[64] = {};
+    for(int i = 0; i < 32; i++) {
+        x[i] = r[i];
+    }
+    for(int i = 0; i < 32; i++) {
+        for(int j = 0; j < 32; j++) {
+            x[i + j] += static_cast<std::int64_t>(k[i]) * expanded[j];
+        }
+    }
+    ReduceModL(signature + 32, x);
+}
+#endif
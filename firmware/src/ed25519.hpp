@@ -0,0 +1,41 @@
+/*******************************************************************************
+  Ed25519 signatures
+
+  File Name:
+    ed25519.hpp
+
+  Summary:
+    Ed25519 signature verification (RFC 8032), and signing for the host.
+
+  Description:
+    A small, portable implementation for verifying image signatures. Field
+    elements are held in sixteen 16 bit limbs of 64 bit integers, and points
+    are multiplied with a shared double-and-add loop over both scalars. This
+    favours code size over speed; verification is done once per image.
+
+    Signing is only built for the host side packer. The secret key is the 32
+    byte seed of RFC 8032.
+ *******************************************************************************/
+
+#ifndef ED25519_HPP
+#define ED25519_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+static constexpr const std::size_t ED25519_PUBLIC_KEY_SIZE = 32;
+static constexpr const std::size_t ED25519_SECRET_KEY_SIZE = 32;
+static constexpr const std::size_t ED25519_SIGNATURE_SIZE = 64;
+
+/* Checks the signature of message. Non canonical signatures are rejected. */
+bool Ed25519Verify(const std::uint8_t* signature, const void* message, std::size_t length, const std::uint8_t* publicKey);
+
+#if !defined(__arm__)
+/* Derives the public key from the secret key. */
+void Ed25519GetPublicKey(std::uint8_t* publicKey, const std::uint8_t* secretKey);
+
+/* Signs message. */
+void Ed25519Sign(std::uint8_t* signature, const void* message, std::size_t length, const std::uint8_t* secretKey);
+#endif
+
+#endif //ED25519_HPP
@@ -0,0 +1,60 @@
+/*******************************************************************************
+  Flash device interface
+
+  File Name:
+    flash_device.hpp
+
+  Summary:
+    Common interface of the flash memories the loader programs.
+
+  Description:
+    FlashPageWriter programs a device through this interface, so the same
+    read/program path serves the internal flash and the external QSPI flash,
+    and a simulated device can stand in for either of them.
+
+    Addresses are in the address space of the device. Pages are always
+    FLASH_DEVICE_PAGE_SIZE bytes; a device with smaller program units
+    programs a page in several steps.
+
+    The erase/program methods are called from the flashing engine in RAM, so
+    implementations must place them and everything they call in RAM as well
+    (see ramfunc.hpp).
+ *******************************************************************************/
+
+#ifndef FLASH_DEVICE_HPP
+#define FLASH_DEVICE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+static constexpr const std::uintptr_t FLASH_DEVICE_PAGE_SIZE = 512;
+
+class FlashDevice
+{
+public:
+    /* Size of the erase unit. A multiple of FLASH_DEVICE_PAGE_SIZE. */
+    virtual std::uintptr_t GetBlockSize() const = 0;
+
+    /* Prepares the device for a programming session, e.g. clears stale errors. */
+    virtual void Begin() = 0;
+
+    /* Waits until the previous erase/program operation has completed. */
+    virtual void WaitReady() = 0;
+
+    /* Starts erasing the block at address. Returns before completion if the device allows it. */
+    virtual void EraseBlock(std::uintptr_t address) = 0;
+
+    /* Starts programming one page. The data is consumed before returning. */
+    virtual void WritePage(const std::uint32_t* data, std::uintptr_t address) = 0;
+
+    /* Waits for the last operation and makes the new contents visible to Read(). Returns false on a device error. */
+    virtual bool End() = 0;
+
+    /* Reads the current contents. */
+    virtual void Read(std::uintptr_t address, void* buffer, std::size_t length) = 0;
+
+protected:
+    ~FlashDevice() = default;
+};
+
+#endif //FLASH_DEVICE_HPP
@@ -0,0 +1,202 @@
+/*******************************************************************************
+  Flash page writer
+
+  File Name:
+    flash_writer.cpp
+
+  Summary:
+    Collects sparse writes into flash pages and programs them.
+ *******************************************************************************/
+
+#include "flash_writer.hpp"
+#include "definitions.h"
+#include <algorithm>
+#include <cstring>
+
+FlashPageWriter::FlashPageWriter(FlashDevice& device, std::uintptr_t lowerBound, std::uintptr_t upperBound)
+    : device(device), blockSize(device.GetBlockSize()), baseAddress(lowerBound & ~(device.GetBlockSize() - 1)),
+      lowerBound(lowerBound), upperBound(std::min(upperBound, baseAddress + MaxRangeSize)), useCounter(0), programmedPageCount(0),
+      erasedBlockCount(0), eraseCycles(0), programCycles(0), erasedBlocks(), programmedPages(), slots(), heldSlot()
+{
+    for(auto& slot : this->slots) {
+        slot.address = NoPage;
+    }
+    this->heldSlot.address = NoPage;
+}
+
+void FlashPageWriter::Reset()
+{
+    this->device.Begin();
+    for(auto& slot : this->slots) {
+        slot.address = NoPage;
+    }
+    this->heldSlot.address = NoPage;
+    this->useCounter = 0;
+    this->programmedPageCount = 0;
+    this->erasedBlockCount = 0;
+    this->eraseCycles = 0;
+    this->programCycles = 0;
+    std::memset(this->erasedBlocks, 0, sizeof(this->erasedBlocks));
+    std::memset(this->programmedPages, 0, sizeof(this->programmedPages));
+}
+
+bool FlashPageWriter::IsPageProgrammed(std::uintptr_t page) const
+{
+    auto index = (page - this->baseAddress) / PageSize;
+    return (this->programmedPages[index / 32] & (1u << (index % 32))) != 0;
+}
+
+FlashPageWriter::PageSlot* FlashPageWriter::FindSlot(std::uintptr_t page)
+{
+    if( page != NoPage && page == this->heldSlot.address ) {
+        return &this->heldSlot;
+    }
+    for(auto& slot : this->slots) {
+        if( slot.address == page ) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+std::uint8_t* FlashPageWriter::Reserve(std::uintptr_t address, std::size_t length)
+{
+    auto page = address & ~(PageSize - 1);
+    if( length == 0 || !this->Contains(address, length) || length > PageSize - (address - page) ) {
+        return nullptr;
+    }
+
+    auto slot = this->FindSlot(page);
+    if( slot == nullptr ) {
+        if( this->IsPageProgrammed(page) ) {
+            return nullptr;
+        }
+        // Take a free slot, or program the least recently used page to make room.
+        slot = this->FindSlot(NoPage);
+        if( slot == nullptr ) {
+            slot = std::min_element(this->slots.begin(), this->slots.end(), [](const PageSlot& lhs, const PageSlot& rhs) {
+                return lhs.lastUsed < rhs.lastUsed;
+            });
+            if( !this->ProgramSlot(*slot) ) {
+                return nullptr;
+            }
+        }
+        slot->address = page;
+        slot->bytesWritten = 0;
+        std::memset(slot->buffer, 0xff, PageSize);
+    }
+    slot->lastUsed = ++this->useCounter;
+    return reinterpret_cast<std::uint8_t*>(slot->buffer) + (address - page);
+}
+
+bool FlashPageWriter::Commit(std::uintptr_t address, std::size_t length)
+{
+    auto slot = this->FindSlot(address & ~(PageSize - 1));
+    if( slot == nullptr ) {
+        return false;
+    }
+    slot->bytesWritten += length;
+    if( slot->bytesWritten >= PageSize && slot != &this->heldSlot ) {
+        return this->ProgramSlot(*slot);
+    }
+    return true;
+}
+
+bool FlashPageWriter::Write(std::uintptr_t address, const void* data, std::size_t length)
+{
+    auto source = static_cast<const std::uint8_t*>(data);
+    while( length > 0 ) {
+        auto bytesToCopy = std::min<std::size_t>(length, PageSize - (address & (PageSize - 1)));
+        auto destination = this->Reserve(address, bytesToCopy);
+        if( destination == nullptr ) {
+            return false;
+        }
+        std::memcpy(destination, source, bytesToCopy);
+        if( !this->Commit(address, bytesToCopy) ) {
+            return false;
+        }
+        source += bytesToCopy;
+        address += bytesToCopy;
+        length -= bytesToCopy;
+    }
+    return true;
+}
+
+bool FlashPageWriter::ProgramSlot(PageSlot& slot)
+{
+    auto offset = slot.address - this->baseAddress;
+    auto block = offset / this->blockSize;
+    if( (this->erasedBlocks[block / 32] & (1u << (block % 32))) == 0 ) {
+        auto startCycle = DWT->CYCCNT;
+        this->device.WaitReady();
+        this->device.EraseBlock(this->baseAddress + block * this->blockSize);
+        this->erasedBlocks[block / 32] |= 1u << (block % 32);
+        this->erasedBlockCount++;
+        this->eraseCycles += DWT->CYCCNT - startCycle;
+    }
+    // The device consumes the data before WritePage() returns,
+    // so the slot can be reused while the page is being programmed.
+    auto startCycle = DWT->CYCCNT;
+    this->device.WaitReady();
+    this->device.WritePage(slot.buffer, slot.address);
+    this->programCycles += DWT->CYCCNT - startCycle;
+
+    auto page = offset / PageSize;
+    this->programmedPages[page / 32] |= 1u << (page % 32);
+    slot.address = NoPage;
+
+    this->programmedPageCount++;
+    return true;
+}
+
+bool FlashPageWriter::Flush()
+{
+    for(auto& slot : this->slots) {
+        if( slot.address != NoPage && !this->ProgramSlot(slot) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FlashPageWriter::Finish()
+{
+    if( !this->Flush() ) {
+        return false;
+    }
+    if( this->heldSlot.address != NoPage && !this->ProgramSlot(this->heldSlot) ) {
+        return false;
+    }
+    return this->device.End();
+}
+
+bool FlashPageWriter::HoldPage(std::uintptr_t address)
+{
+    auto page = address & ~(PageSize - 1);
+    if( !this->Contains(page, PageSize) ) {
+        return false;
+    }
+    this->heldSlot.address = page;
+    this->heldSlot.bytesWritten = 0;
+    std::memset(this->heldSlot.buffer, 0xff, PageSize);
+    return true;
+}
+
+void FlashPageWriter::Abort()
+{
+    for(auto& slot : this->slots) {
+        slot.address = NoPage;
+    }
+    if( this->heldSlot.address != NoPage ) {
+        // Other pages of the block may have been programmed already. Erase it unless that has happened
+        // in this session, so that the held page does not keep contents of a previous image.
+        auto block = (this->heldSlot.address - this->baseAddress) / this->blockSize;
+        if( (this->erasedBlocks[block / 32] & (1u << (block % 32))) == 0 ) {
+            this->device.WaitReady();
+            this->device.EraseBlock(this->baseAddress + block * this->blockSize);
+            this->erasedBlocks[block / 32] |= 1u << (block % 32);
+        }
+        this->heldSlot.address = NoPage;
+    }
+    this->device.End();
+}
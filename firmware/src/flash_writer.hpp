@@ -0,0 +1,144 @@
+/*******************************************************************************
+  Flash page writer
+
+  File Name:
+    flash_writer.hpp
+
+  Summary:
+    Collects sparse writes into flash pages and programs them.
+
+  Description:
+    Writes may arrive at arbitrary addresses and in any order. They are
+    gathered into a few page buffers. A page is programmed as soon as all of
+    its bytes have been written, or when its buffer is needed for another page.
+    A block is erased only when the first page in it is programmed, so blocks
+    which no write touches are left unchanged. A page is never programmed
+    twice within a session; a write to an already programmed page fails.
+
+    One page can be held back with HoldPage(). It is programmed last, by
+    Finish(), once the caller has verified the whole image; Abort() leaves it
+    erased instead, whether or not its block has been erased before. Holding
+    the page with the vector table keeps an image from being started until
+    it has been verified.
+
+    Callers which read data from a file can avoid an intermediate copy by
+    reading directly into the page buffer returned from Reserve() and then
+    calling Commit().
+
+    The pages are programmed through a FlashDevice. Erase/program commands are
+    not waited for; the writer waits for the device just before the next
+    command, so on devices which allow it, reading the next chunk from the SD
+    card overlaps with the previous erase/program operation.
+
+    The erase/program path runs from RAM (see ramfunc.hpp).
+ *******************************************************************************/
+
+#ifndef FLASH_WRITER_HPP
+#define FLASH_WRITER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include "flash_device.hpp"
+#include "ramfunc.hpp"
+
+class FlashPageWriter
+{
+public:
+    static constexpr const std::uintptr_t PageSize = FLASH_DEVICE_PAGE_SIZE;
+    // Largest range one writer covers, and the smallest block size it supports.
+    static constexpr const std::uintptr_t MaxRangeSize = 4 * 1024 * 1024;
+    static constexpr const std::uintptr_t MinBlockSize = 4096;
+
+    /* Writes to device are accepted only in the range [lowerBound, upperBound).
+       The range is truncated to MaxRangeSize bytes from the block containing lowerBound. */
+    FlashPageWriter(FlashDevice& device, std::uintptr_t lowerBound, std::uintptr_t upperBound);
+
+    FlashDevice& GetDevice() const { return this->device; }
+
+    /* Lowest writable address, e.g. the start of the application. */
+    std::uintptr_t GetLowerBound() const { return this->lowerBound; }
+
+    /* Checks whether [address, address + length) lies within the writable range. */
+    bool Contains(std::uintptr_t address, std::size_t length) const
+    {
+        return address >= this->lowerBound && address <= this->upperBound && length <= this->upperBound - address;
+    }
+
+    /* Starts a new session. Every block is treated as not yet erased. */
+    void Reset();
+
+    /* Returns the page buffer location for [address, address + length), which must not cross a page boundary.
+       The caller fills it and then calls Commit() with the same range before calling any other method.
+       Returns nullptr if the range is not writable or the page has already been programmed. */
+    std::uint8_t* Reserve(std::uintptr_t address, std::size_t length);
+
+    /* Marks a reserved range as written. The page is programmed once it is completely written. */
+    bool Commit(std::uintptr_t address, std::size_t length);
+
+    /* Copies data into the page buffers. */
+    bool Write(std::uintptr_t address, const void* data, std::size_t length);
+
+    /* Programs all pending pages, padding their unwritten bytes with 0xff. */
+    bool Flush();
+
+    /* Flushes, programs the held page and waits for the last device command. Returns false on a device error. */
+    bool Finish();
+
+    /* Holds back the page containing address until Finish(). Call right after Reset().
+       Returns false if the page is not writable. */
+    bool HoldPage(std::uintptr_t address);
+
+    /* Ends the session without programming the pending pages. The held page is left erased. */
+    void Abort();
+
+    /* Number of pages programmed in this session. */
+    std::uint32_t GetProgrammedPageCount() const { return this->programmedPageCount; }
+
+    /* Number of blocks erased in this session. */
+    std::uint32_t GetErasedBlockCount() const { return this->erasedBlockCount; }
+
+    /* DWT cycles spent in the block erase and page program commands of this session,
+       each including the wait for the previous command of the device. */
+    std::uint32_t GetEraseCycles() const { return this->eraseCycles; }
+    std::uint32_t GetProgramCycles() const { return this->programCycles; }
+
+private:
+    static constexpr const std::uintptr_t NoPage = ~static_cast<std::uintptr_t>(0);
+    static constexpr const std::size_t BlockCount = MaxRangeSize / MinBlockSize;
+    static constexpr const std::size_t PageCount = MaxRangeSize / PageSize;
+    // Number of pages which can be assembled at the same time. Enough for mildly out-of-order input.
+    static constexpr const std::size_t SlotCount = 4;
+
+    struct PageSlot
+    {
+        std::uintptr_t address;
+        std::size_t bytesWritten;
+        std::uint32_t lastUsed;
+        std::uint32_t buffer[PageSize/4];
+    };
+
+    PageSlot* FindSlot(std::uintptr_t page);
+    bool IsPageProgrammed(std::uintptr_t page) const;
+    RAMFUNC bool ProgramSlot(PageSlot& slot);
+
+    FlashDevice& device;
+    std::uintptr_t blockSize;
+    // Start of the block containing lowerBound. The bitmaps are indexed relative to it.
+    std::uintptr_t baseAddress;
+    std::uintptr_t lowerBound;
+    std::uintptr_t upperBound;
+    std::uint32_t useCounter;
+    std::uint32_t programmedPageCount;
+    std::uint32_t erasedBlockCount;
+    std::uint32_t eraseCycles;
+    std::uint32_t programCycles;
+    // Bitmaps indexed by block/page number from baseAddress. Plain arrays so that the RAM functions do not call library code.
+    std::uint32_t erasedBlocks[(BlockCount + 31) / 32];
+    std::uint32_t programmedPages[(PageCount + 31) / 32];
+    std::array<PageSlot, SlotCount> slots;
+    // The page held back by HoldPage(). Not subject to eviction.
+    PageSlot heldSlot;
+};
+
+#endif //FLASH_WRITER_HPP
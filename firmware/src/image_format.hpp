@@ -0,0 +1,64 @@
+/*******************************************************************************
+  Packed application image format
+
+  File Name:
+    image_format.hpp
+
+  Summary:
+    Layout of the packed image (app.img) produced by tools/imagepack.
+
+  Description:
+    This header is shared by the firmware and the host side packer, so it must
+    not depend on the Harmony framework.
+
+    A packed image consists of a PackedImageHeader followed by chunkCount
+    chunks. Each chunk is a PackedChunkHeader immediately followed by
+    storedSize bytes of data.
+
+    * A chunk never crosses an IMAGE_CHUNK_SIZE aligned boundary, i.e. it
+      covers a part of exactly one flash erase block.
+    * If storedSize equals rawSize the data is stored as is, otherwise it is
+      compressed with the LZ format described in lz.hpp.
+    * crc is the CRC-32 (see crc32.hpp) of the raw chunk data.
+    * digest is the SHA-256 of, for every chunk in file order, the address
+      and the rawSize as 32 bit little endian values followed by the raw data.
+      It identifies the whole image contents including their placement.
+    * If flags has IMAGE_FLAG_SIGNED, signature is the Ed25519 signature
+      (see ed25519.hpp) of the 32 byte digest. Otherwise it is zero.
+
+    All fields are little endian.
+ *******************************************************************************/
+
+#ifndef IMAGE_FORMAT_HPP
+#define IMAGE_FORMAT_HPP
+
+#include <cstdint>
+
+static constexpr const std::uint32_t IMAGE_MAGIC = 0x474D4957;    // "WIMG"
+static constexpr const std::uint16_t IMAGE_VERSION = 2;
+static constexpr const std::uint32_t IMAGE_CHUNK_SIZE = 8192;
+static constexpr const std::uint32_t IMAGE_FLAG_SIGNED = 0x00000001;
+
+struct PackedImageHeader
+{
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t headerSize;
+    std::uint32_t chunkCount;
+    std::uint32_t totalSize;        // Sum of rawSize of all chunks.
+    std::uint8_t  digest[32];
+    std::uint32_t flags;
+    std::uint8_t  signature[64];
+};
+static_assert(sizeof(PackedImageHeader) == 116, "PackedImageHeader must not contain padding");
+
+struct PackedChunkHeader
+{
+    std::uint32_t address;
+    std::uint16_t rawSize;
+    std::uint16_t storedSize;
+    std::uint32_t crc;
+};
+static_assert(sizeof(PackedChunkHeader) == 12, "PackedChunkHeader must not contain padding");
+
+#endif //IMAGE_FORMAT_HPP
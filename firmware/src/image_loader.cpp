@@ -0,0 +1,475 @@
+/*******************************************************************************
+  Application image loader
+
+  File Name:
+    image_loader.cpp
+
+  Summary:
+    Reads application images from an open file and programs them into flash.
+ *******************************************************************************/
+
+#include "image_loader.hpp"
+#include "image_format.hpp"
+#include "crc32.hpp"
+#include "sha256.hpp"
+#include "ed25519.hpp"
+#include "lz.hpp"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstring>
+
+// Minimal subset of the ELF32 definitions. Only the fields needed to locate the loadable segments are used.
+struct Elf32Header
+{
+    std::uint8_t  ident[16];
+    std::uint16_t type;
+    std::uint16_t machine;
+    std::uint32_t version;
+    std::uint32_t entry;
+    std::uint32_t phoff;
+    std::uint32_t shoff;
+    std::uint32_t flags;
+    std::uint16_t ehsize;
+    std::uint16_t phentsize;
+    std::uint16_t phnum;
+    std::uint16_t shentsize;
+    std::uint16_t shnum;
+    std::uint16_t shstrndx;
+};
+static_assert(sizeof(Elf32Header) == 52, "Elf32Header must match the ELF32 file header layout");
+
+struct Elf32ProgramHeader
+{
+    std::uint32_t type;
+    std::uint32_t offset;
+    std::uint32_t vaddr;
+    std::uint32_t paddr;
+    std::uint32_t filesz;
+    std::uint32_t memsz;
+    std::uint32_t flags;
+    std::uint32_t align;
+};
+static_assert(sizeof(Elf32ProgramHeader) == 32, "Elf32ProgramHeader must match the ELF32 program header layout");
+
+static constexpr const std::uint8_t ELF_CLASS32 = 1;
+static constexpr const std::uint8_t ELF_DATA2LSB = 1;
+static constexpr const std::uint16_t ELF_TYPE_EXEC = 2;
+static constexpr const std::uint16_t ELF_MACHINE_ARM = 40;
+static constexpr const std::uint32_t ELF_PT_LOAD = 1;
+
+// Upper limit of the program headers handled. A typical application has only a few.
+static constexpr const std::size_t MAX_SEGMENTS = 16;
+
+// UF2 block layout. See https://github.com/microsoft/uf2
+struct Uf2BlockHeader
+{
+    std::uint32_t magicStart0;
+    std::uint32_t magicStart1;
+    std::uint32_t flags;
+    std::uint32_t targetAddr;
+    std::uint32_t payloadSize;
+    std::uint32_t blockNo;
+    std::uint32_t numBlocks;
+    std::uint32_t familyID;     // Holds the file size instead when UF2_FLAG_FAMILY_ID_PRESENT is not set.
+};
+static_assert(sizeof(Uf2BlockHeader) == 32, "Uf2BlockHeader must match the UF2 block header layout");
+
+static constexpr const std::uint32_t UF2_MAGIC_START0 = 0x0A324655;
+static constexpr const std::uint32_t UF2_MAGIC_START1 = 0x9E5D5157;
+static constexpr const std::uint32_t UF2_MAGIC_END = 0x0AB16F30;
+static constexpr const std::uint32_t UF2_FLAG_NOT_MAIN_FLASH = 0x00000001;
+static constexpr const std::uint32_t UF2_FLAG_FILE_CONTAINER = 0x00001000;
+static constexpr const std::uint32_t UF2_FLAG_FAMILY_ID_PRESENT = 0x00002000;
+static constexpr const std::uint32_t UF2_FAMILY_ID_SAMD51 = 0x55114460;
+static constexpr const std::size_t UF2_BLOCK_SIZE = 512;
+// Blocks carry 256 bytes at a 256 byte aligned address, as written by uf2conv.py and the UF2 bootloaders.
+static constexpr const std::uint32_t UF2_PAYLOAD_SIZE = 256;
+static constexpr const std::size_t UF2_MAX_BLOCKS = NVMCTRL_FLASH_SIZE / UF2_PAYLOAD_SIZE;
+// Marks an address without a block in uf2BlockIndex.
+static constexpr const std::uint16_t UF2_NO_BLOCK = 0xffff;
+
+static std::bitset<UF2_MAX_BLOCKS> uf2ReceivedBlocks;
+static std::uint8_t uf2Block[UF2_BLOCK_SIZE];
+// Index of the block in the file for each 256 byte unit of the flash.
+static std::uint16_t uf2BlockIndex[UF2_MAX_BLOCKS];
+
+static_assert(IMAGE_CHUNK_SIZE == NVMCTRL_FLASH_BLOCKSIZE, "A packed image chunk must correspond to a flash block");
+static std::uint8_t chunkInput[IMAGE_CHUNK_SIZE];
+static std::uint8_t chunkOutput[IMAGE_CHUNK_SIZE];
+
+#if defined(IMAGE_PUBLIC_KEY)
+static const std::uint8_t imagePublicKey[ED25519_PUBLIC_KEY_SIZE] = { IMAGE_PUBLIC_KEY };
+#endif
+
+static ImageVerificationCycles verificationCycles;
+
+const ImageVerificationCycles& GetImageVerificationCycles()
+{
+    return verificationCycles;
+}
+
+static void (*idleHandler)() = nullptr;
+
+void SetImageLoadIdleHandler(void (*handler)())
+{
+    idleHandler = handler;
+}
+
+static bool ReadExact(SYS_FS_HANDLE handle, void* buffer, std::size_t length)
+{
+    if( idleHandler != nullptr ) {
+        idleHandler();
+    }
+    return SYS_FS_FileRead(handle, buffer, length) == length;
+}
+
+// Feeds image contents into the digest, counting the cycles spent.
+static void UpdateImageDigest(Sha256& sha, const void* data, std::size_t length)
+{
+    auto startCycle = DWT->CYCCNT;
+    sha.Update(data, length);
+    verificationCycles.hash += DWT->CYCCNT - startCycle;
+    verificationCycles.hashedBytes += length;
+}
+
+// Reads `length` bytes from the current file position into the flash at `address`.
+// The data is read directly into the page buffers of the writer.
+static bool CopyToFlash(SYS_FS_HANDLE handle, FlashPageWriter& writer, std::uintptr_t address, std::uint32_t length)
+{
+    while( length > 0 ) {
+        auto bytesToRead = std::min<std::uint32_t>(length, FlashPageWriter::PageSize - (address & (FlashPageWriter::PageSize - 1)));
+        auto destination = writer.Reserve(address, bytesToRead);
+        if( destination == nullptr ) {
+            return false;
+        }
+        if( !ReadExact(handle, destination, bytesToRead) ) {
+            return false;
+        }
+        if( !writer.Commit(address, bytesToRead) ) {
+            return false;
+        }
+        address += bytesToRead;
+        length -= bytesToRead;
+    }
+    return true;
+}
+
+bool LoadBinaryImage(SYS_FS_HANDLE handle, FlashPageWriter& writer, std::uintptr_t baseAddress)
+{
+    auto fileSize = SYS_FS_FileSize(handle);
+    if( fileSize <= 0 || !writer.Contains(baseAddress, fileSize) ) {
+        return false;
+    }
+    writer.Reset();
+    if( !CopyToFlash(handle, writer, baseAddress, static_cast<std::uint32_t>(fileSize)) ) {
+        return false;
+    }
+    return writer.Finish();
+}
+
+bool LoadElfImage(SYS_FS_HANDLE handle, FlashPageWriter& writer)
+{
+    Elf32Header header;
+    if( !ReadExact(handle, &header, sizeof(header)) ) {
+        return false;
+    }
+    if( header.ident[0] != 0x7f || header.ident[1] != 'E' || header.ident[2] != 'L' || header.ident[3] != 'F'
+     || header.ident[4] != ELF_CLASS32 || header.ident[5] != ELF_DATA2LSB
+     || header.type != ELF_TYPE_EXEC || header.machine != ELF_MACHINE_ARM
+     || header.phentsize != sizeof(Elf32ProgramHeader) || header.phnum == 0 || header.phnum > MAX_SEGMENTS ) {
+        return false;
+    }
+
+    std::array<Elf32ProgramHeader, MAX_SEGMENTS> segments;
+    if( SYS_FS_FileSeek(handle, header.phoff, SYS_FS_SEEK_SET) < 0 ) {
+        return false;
+    }
+    if( !ReadExact(handle, segments.data(), header.phnum * sizeof(Elf32ProgramHeader)) ) {
+        return false;
+    }
+
+    // Drop everything which has no contents to program (.bss, .stack, non-loadable headers).
+    auto end = std::remove_if(segments.begin(), segments.begin() + header.phnum, [](const Elf32ProgramHeader& segment) {
+        return segment.type != ELF_PT_LOAD || segment.filesz == 0;
+    });
+    if( end == segments.begin() ) {
+        return false;
+    }
+    // Reject the image before anything is erased.
+    for(auto it = segments.begin(); it != end; ++it) {
+        if( !writer.Contains(it->paddr, it->filesz) ) {
+            return false;
+        }
+    }
+    // The page writer programs each page once, so the segments must be visited in address order.
+    std::sort(segments.begin(), end, [](const Elf32ProgramHeader& lhs, const Elf32ProgramHeader& rhs) {
+        return lhs.paddr < rhs.paddr;
+    });
+    for(auto it = segments.begin() + 1; it != end; ++it) {
+        auto& previous = *(it - 1);
+        if( previous.paddr + previous.filesz > it->paddr ) {
+            return false;
+        }
+    }
+
+    writer.Reset();
+    for(auto it = segments.begin(); it != end; ++it) {
+        if( SYS_FS_FileSeek(handle, it->offset, SYS_FS_SEEK_SET) < 0 ) {
+            return false;
+        }
+        if( !CopyToFlash(handle, writer, it->paddr, it->filesz) ) {
+            return false;
+        }
+    }
+    return writer.Finish();
+}
+
+bool LoadUf2Image(SYS_FS_HANDLE handle, FlashPageWriter& writer)
+{
+    auto fileSize = SYS_FS_FileSize(handle);
+    if( fileSize <= 0 || fileSize % UF2_BLOCK_SIZE != 0 || fileSize / UF2_BLOCK_SIZE >= UF2_NO_BLOCK ) {
+        return false;
+    }
+
+    // The first pass validates every block and records where it is in the file, so that a broken file
+    // is rejected before anything is erased. The blocks may be in any order.
+    std::uint32_t numBlocks = 0;
+    uf2ReceivedBlocks.reset();
+    std::fill(uf2BlockIndex, uf2BlockIndex + UF2_MAX_BLOCKS, UF2_NO_BLOCK);
+    for(std::int32_t blockOffset = 0; blockOffset < fileSize; blockOffset += UF2_BLOCK_SIZE) {
+        // One read per block, which is one sector of the card. The block is parsed in memory.
+        if( !ReadExact(handle, uf2Block, UF2_BLOCK_SIZE) ) {
+            return false;
+        }
+        Uf2BlockHeader header;
+        std::uint32_t magicEnd;
+        std::memcpy(&header, uf2Block, sizeof(header));
+        std::memcpy(&magicEnd, uf2Block + UF2_BLOCK_SIZE - sizeof(magicEnd), sizeof(magicEnd));
+        if( header.magicStart0 != UF2_MAGIC_START0 || header.magicStart1 != UF2_MAGIC_START1 || magicEnd != UF2_MAGIC_END ) {
+            return false;
+        }
+
+        // Blocks for other targets may be mixed into the same file. They are skipped.
+        auto skip = (header.flags & (UF2_FLAG_NOT_MAIN_FLASH | UF2_FLAG_FILE_CONTAINER)) != 0
+                 || ((header.flags & UF2_FLAG_FAMILY_ID_PRESENT) != 0 && header.familyID != UF2_FAMILY_ID_SAMD51);
+        if( skip ) {
+            continue;
+        }
+        if( numBlocks == 0 ) {
+            if( header.numBlocks == 0 || header.numBlocks > UF2_MAX_BLOCKS ) {
+                return false;
+            }
+            numBlocks = header.numBlocks;
+        }
+        if( header.numBlocks != numBlocks || header.blockNo >= numBlocks || uf2ReceivedBlocks.test(header.blockNo) ) {
+            return false;
+        }
+        uf2ReceivedBlocks.set(header.blockNo);
+
+        auto unit = header.targetAddr / UF2_PAYLOAD_SIZE;
+        if( header.payloadSize != UF2_PAYLOAD_SIZE || header.targetAddr % UF2_PAYLOAD_SIZE != 0 || unit >= UF2_MAX_BLOCKS
+         || !writer.Contains(header.targetAddr, header.payloadSize) || uf2BlockIndex[unit] != UF2_NO_BLOCK ) {
+            return false;
+        }
+        uf2BlockIndex[unit] = static_cast<std::uint16_t>(blockOffset / UF2_BLOCK_SIZE);
+    }
+    // Every block of the image must have been found.
+    if( numBlocks == 0 || uf2ReceivedBlocks.count() != numBlocks ) {
+        return false;
+    }
+
+    // The second pass programs the blocks in address order, so that every page is completed before the next one
+    // is started. The payloads are read directly into the page buffers of the writer.
+    writer.Reset();
+    for(std::size_t unit = 0; unit < UF2_MAX_BLOCKS; unit++) {
+        if( uf2BlockIndex[unit] == UF2_NO_BLOCK ) {
+            continue;
+        }
+        if( SYS_FS_FileSeek(handle, uf2BlockIndex[unit] * UF2_BLOCK_SIZE + sizeof(Uf2BlockHeader), SYS_FS_SEEK_SET) < 0 ) {
+            return false;
+        }
+        if( !CopyToFlash(handle, writer, unit * UF2_PAYLOAD_SIZE, UF2_PAYLOAD_SIZE) ) {
+            return false;
+        }
+    }
+    return writer.Finish();
+}
+
+// Reads and validates the header of a packed image at the current file position.
+static bool ReadPackedImageHeader(SYS_FS_HANDLE handle, PackedImageHeader& header, const std::uint8_t* expectedDigest)
+{
+    if( !ReadExact(handle, &header, sizeof(header)) ) {
+        return false;
+    }
+    if( header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION || header.headerSize != sizeof(header) || header.chunkCount == 0 ) {
+        return false;
+    }
+    return expectedDigest == nullptr || std::memcmp(header.digest, expectedDigest, sizeof(header.digest)) == 0;
+}
+
+// Checks the signature of the image digest if signatures are required.
+static bool IsImageSignatureValid(const PackedImageHeader& header)
+{
+#if defined(IMAGE_PUBLIC_KEY)
+    auto startCycle = DWT->CYCCNT;
+    auto valid = (header.flags & IMAGE_FLAG_SIGNED) != 0 && Ed25519Verify(header.signature, header.digest, sizeof(header.digest), imagePublicKey);
+    verificationCycles.signature = DWT->CYCCNT - startCycle;
+    return valid;
+#else
+    static_cast<void>(header);
+    return true;
+#endif
+}
+
+// The digest covers the placement of every chunk, followed by its raw data.
+static void GetChunkPlacement(const PackedChunkHeader& chunk, std::uint8_t* placement)
+{
+    for(int i = 0; i < 4; i++) {
+        placement[i + 0] = static_cast<std::uint8_t>(chunk.address >> (i*8));
+        placement[i + 4] = static_cast<std::uint8_t>(static_cast<std::uint32_t>(chunk.rawSize) >> (i*8));
+    }
+}
+
+bool IsPackedImageInstalled(SYS_FS_HANDLE handle, FlashPageWriter& writer, const std::uint8_t* expectedDigest)
+{
+    PackedImageHeader header;
+    if( !ReadPackedImageHeader(handle, header, expectedDigest) ) {
+        return false;
+    }
+
+    // Hash the current flash contents at the placement of every chunk, as the digest is defined over the raw data.
+    auto& device = writer.GetDevice();
+    Sha256 sha;
+    auto offset = sizeof(header);
+    for(std::uint32_t index = 0; index < header.chunkCount; index++) {
+        PackedChunkHeader chunk;
+        if( SYS_FS_FileSeek(handle, offset, SYS_FS_SEEK_SET) < 0 || !ReadExact(handle, &chunk, sizeof(chunk)) ) {
+            return false;
+        }
+        if( chunk.rawSize > IMAGE_CHUNK_SIZE || !writer.Contains(chunk.address, chunk.rawSize) ) {
+            return false;
+        }
+        std::uint8_t placement[8];
+        GetChunkPlacement(chunk, placement);
+        device.Read(chunk.address, chunkOutput, chunk.rawSize);
+        sha.Update(placement, sizeof(placement));
+        sha.Update(chunkOutput, chunk.rawSize);
+        offset += sizeof(chunk) + chunk.storedSize;
+    }
+
+    std::uint8_t digest[Sha256::DigestSize];
+    sha.Final(digest);
+    if( std::memcmp(digest, header.digest, sizeof(digest)) != 0 ) {
+        return false;
+    }
+    // Contents installed by other means are not trusted when signatures are required.
+    return IsImageSignatureValid(header);
+}
+
+bool GetPackedImageBlockRange(SYS_FS_HANDLE handle, FlashPageWriter& writer, std::uintptr_t& begin, std::uintptr_t& end)
+{
+    PackedImageHeader header;
+    if( !ReadPackedImageHeader(handle, header, nullptr) ) {
+        return false;
+    }
+
+    auto blockSize = writer.GetDevice().GetBlockSize();
+    begin = ~static_cast<std::uintptr_t>(0);
+    end = 0;
+    auto offset = sizeof(header);
+    for(std::uint32_t index = 0; index < header.chunkCount; index++) {
+        PackedChunkHeader chunk;
+        if( SYS_FS_FileSeek(handle, offset, SYS_FS_SEEK_SET) < 0 || !ReadExact(handle, &chunk, sizeof(chunk)) ) {
+            return false;
+        }
+        if( chunk.rawSize == 0 || chunk.rawSize > IMAGE_CHUNK_SIZE || !writer.Contains(chunk.address, chunk.rawSize) ) {
+            return false;
+        }
+        begin = std::min<std::uintptr_t>(begin, chunk.address & ~(blockSize - 1));
+        end = std::max<std::uintptr_t>(end, (chunk.address + chunk.rawSize + blockSize - 1) & ~(blockSize - 1));
+        offset += sizeof(chunk) + chunk.storedSize;
+    }
+    return true;
+}
+
+// Programs the chunks following the header, feeding their contents into sha.
+static bool ProgramPackedImage(SYS_FS_HANDLE handle, FlashPageWriter& writer, const PackedImageHeader& header, bool bootable, Sha256& sha)
+{
+    std::uint32_t totalSize = 0;
+    for(std::uint32_t index = 0; index < header.chunkCount; index++) {
+        PackedChunkHeader chunk;
+        if( !ReadExact(handle, &chunk, sizeof(chunk)) ) {
+            return false;
+        }
+        if( chunk.rawSize == 0 || chunk.storedSize > chunk.rawSize
+         || (chunk.address & (IMAGE_CHUNK_SIZE - 1)) + chunk.rawSize > IMAGE_CHUNK_SIZE
+         || !writer.Contains(chunk.address, chunk.rawSize) ) {
+            return false;
+        }
+        if( index == 0 && bootable ) {
+            // The vector table at the start of the application is programmed only after verification.
+            // Holding it before anything is written keeps it erased on failure, whatever order the other chunks come in.
+            if( chunk.address != writer.GetLowerBound() || !writer.HoldPage(chunk.address) ) {
+                return false;
+            }
+        }
+
+        std::uint8_t placement[8];
+        GetChunkPlacement(chunk, placement);
+        UpdateImageDigest(sha, placement, sizeof(placement));
+
+        // The whole chunk is checked before any of it goes into the page buffers.
+        if( chunk.storedSize == chunk.rawSize ) {
+            if( !ReadExact(handle, chunkOutput, chunk.rawSize) ) {
+                return false;
+            }
+        }
+        else {
+            if( !ReadExact(handle, chunkInput, chunk.storedSize) ) {
+                return false;
+            }
+            if( LzDecompress(chunkInput, chunk.storedSize, chunkOutput, chunk.rawSize) != chunk.rawSize ) {
+                return false;
+            }
+        }
+        if( Crc32Update(0, chunkOutput, chunk.rawSize) != chunk.crc ) {
+            return false;
+        }
+        UpdateImageDigest(sha, chunkOutput, chunk.rawSize);
+        if( !writer.Write(chunk.address, chunkOutput, chunk.rawSize) ) {
+            return false;
+        }
+        totalSize += chunk.rawSize;
+    }
+    return totalSize == header.totalSize;
+}
+
+bool LoadPackedImage(SYS_FS_HANDLE handle, FlashPageWriter& writer, bool bootable, const std::uint8_t* expectedDigest)
+{
+    PackedImageHeader header;
+    if( !ReadPackedImageHeader(handle, header, expectedDigest) ) {
+        return false;
+    }
+
+    verificationCycles = ImageVerificationCycles();
+    writer.Reset();
+    // The signature covers the digest in the header, so it is checked before anything is erased.
+    // The contents are then hashed while they are programmed, and compared against the signed digest at the end.
+    if( !IsImageSignatureValid(header) ) {
+        return false;
+    }
+
+    Sha256 sha;
+    std::uint8_t digest[Sha256::DigestSize];
+    if( !ProgramPackedImage(handle, writer, header, bootable, sha) ) {
+        writer.Abort();
+        return false;
+    }
+    sha.Final(digest);
+    if( std::memcmp(digest, header.digest, sizeof(digest)) != 0 ) {
+        writer.Abort();
+        return false;
+    }
+    return writer.Finish();
+}
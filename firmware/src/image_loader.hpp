@@ -0,0 +1,100 @@
+/*******************************************************************************
+  Application image loader
+
+  File Name:
+    image_loader.hpp
+
+  Summary:
+    Reads application images from an open file and programs them into flash.
+
+  Description:
+    Four image formats are supported.
+
+    * Packed image (app.img)
+        The output of tools/imagepack, described in image_format.hpp. Chunks
+        are stored either as is or LZ compressed, each with its load address
+        and a CRC-32 of its raw contents. Each chunk is checked before any
+        of it is handed to the flash writer.
+        The image digest in the header allows to tell whether the image is
+        already programmed, so that unchanged images are not rewritten.
+
+        If the firmware is built with IMAGE_PUBLIC_KEY, the digest must be
+        signed with the matching Ed25519 key. The signature is checked before
+        anything is erased. The digest of the contents is computed while they
+        are programmed. Neither the file nor the flash is read a second time.
+
+        A bootable image must start with a chunk at the lower bound of the
+        writer, i.e. the vector table of the application. That page is held
+        back until the whole image has been checked, and is left erased if
+        any check fails, so an image which fails verification is never
+        started.
+    * Raw binary (app.bin)
+        The output of `objcopy -O binary`. The whole file is programmed
+        contiguously from the base address.
+    * ELF (app.elf)
+        Only PT_LOAD program headers with file contents are programmed, at
+        their physical (load) address. Gaps between segments are neither read
+        nor programmed, so the load time is proportional to the actual content
+        of the application rather than to its address span.
+    * UF2 (app.uf2)
+        Blocks carrying a SAMD51 family ID (or no family ID) are programmed
+        at their target address. Each must carry 256 bytes at a 256 byte
+        aligned address, as written by uf2conv.py. The file is read twice.
+        The first pass reads every block with a single 512 byte read, checks
+        it and records its position by target address, so a file with a bad
+        block or a missing or duplicated block number is rejected before
+        anything is erased. The second pass reads the payloads in address
+        order directly into the page buffers, so the blocks may appear in
+        the file in any order.
+ *******************************************************************************/
+
+#ifndef IMAGE_LOADER_HPP
+#define IMAGE_LOADER_HPP
+
+#include <cstdint>
+#include "definitions.h"
+#include "flash_writer.hpp"
+
+#if defined(IMAGE_PUBLIC_KEY)
+/* Only signed packed images are accepted. */
+static constexpr const bool IMAGE_SIGNATURE_REQUIRED = true;
+#else
+static constexpr const bool IMAGE_SIGNATURE_REQUIRED = false;
+#endif
+
+/* CPU cycles spent on verifying the last image loaded by LoadPackedImage(). */
+struct ImageVerificationCycles
+{
+    std::uint32_t hash;             // Updating the digest with the image contents
+    std::uint32_t hashedBytes;      // Bytes fed into the digest
+    std::uint32_t signature;        // Verifying the signature of the digest
+};
+const ImageVerificationCycles& GetImageVerificationCycles();
+
+/* Sets a function which the loaders call before every read from the image file, so that other work can go on
+   while an image is loaded. It must not use the file system. nullptr removes it. */
+void SetImageLoadIdleHandler(void (*handler)());
+
+/* Programs the chunks of a packed image. If bootable, the image is an application starting at the lower bound of writer.
+   If expectedDigest is given, the image digest must match it. */
+bool LoadPackedImage(SYS_FS_HANDLE handle, FlashPageWriter& writer, bool bootable, const std::uint8_t* expectedDigest = nullptr);
+
+/* Checks whether the flash already holds the packed image, by hashing the flash contents at the placement of its chunks.
+   If expectedDigest is given, the image digest must match it. If signatures are required, the image must be signed.
+   The file position is left undefined. */
+bool IsPackedImageInstalled(SYS_FS_HANDLE handle, FlashPageWriter& writer, const std::uint8_t* expectedDigest = nullptr);
+
+/* Gets the erase blocks of the device of writer which the packed image touches, as the address range [begin, end).
+   The file position is left undefined. */
+bool GetPackedImageBlockRange(SYS_FS_HANDLE handle, FlashPageWriter& writer, std::uintptr_t& begin, std::uintptr_t& end);
+
+/* Programs the whole file from baseAddress. */
+bool LoadBinaryImage(SYS_FS_HANDLE handle, FlashPageWriter& writer, std::uintptr_t baseAddress);
+
+/* Programs the loadable segments of an ELF32 ARM executable. */
+bool LoadElfImage(SYS_FS_HANDLE handle, FlashPageWriter& writer);
+
+/* Programs the main flash blocks of a UF2 file. */
+bool LoadUf2Image(SYS_FS_HANDLE handle, FlashPageWriter& writer);
+
+#endif //IMAGE_LOADER_HPP
@@ -0,0 +1,57 @@
+/*******************************************************************************
+  Internal flash device
+
+  File Name:
+    internal_flash.cpp
+
+  Summary:
+    FlashDevice for the internal flash of the SAMD51, programmed by NVMCTRL.
+ *******************************************************************************/
+
+#include "internal_flash.hpp"
+#include <cstring>
+
+static_assert(NVMCTRL_FLASH_PAGESIZE == FLASH_DEVICE_PAGE_SIZE, "The NVMCTRL page must match the writer page");
+
+void InternalFlash::Begin()
+{
+    this->WaitReady();
+    // Discard stale error flags so that End() only reports errors of this session.
+    NVMCTRL_ErrorGet();
+}
+
+// Equivalent to NVMCTRL_IsBusy()
+void InternalFlash::WaitReady()
+{
+    while( (NVMCTRL_REGS->NVMCTRL_STATUS & NVMCTRL_STATUS_READY_Msk) == 0 );
+}
+
+// Equivalent to NVMCTRL_BlockErase()
+void InternalFlash::EraseBlock(std::uintptr_t address)
+{
+    NVMCTRL_REGS->NVMCTRL_ADDR = address;
+    NVMCTRL_REGS->NVMCTRL_CTRLB = NVMCTRL_CTRLB_CMD_EB | NVMCTRL_CTRLB_CMDEX_KEY;
+}
+
+// Equivalent to NVMCTRL_PageWrite(). The page buffer is loaded by writing the words to the page address,
+// then the address is set and the write page command is issued.
+void InternalFlash::WritePage(const std::uint32_t* data, std::uintptr_t address)
+{
+    auto destination = reinterpret_cast<volatile std::uint32_t*>(address);
+    for(std::size_t i = 0; i < FLASH_DEVICE_PAGE_SIZE/4; i++) {
+        destination[i] = data[i];
+    }
+    NVMCTRL_REGS->NVMCTRL_ADDR = address;
+    NVMCTRL_REGS->NVMCTRL_CTRLB = NVMCTRL_CTRLB_CMD_WP | NVMCTRL_CTRLB_CMDEX_KEY;
+}
+
+bool InternalFlash::End()
+{
+    this->WaitReady();
+    return NVMCTRL_ErrorGet() == NVMCTRL_ERROR_NONE;
+}
+
+void InternalFlash::Read(std::uintptr_t address, void* buffer, std::size_t length)
+{
+    std::memcpy(buffer, reinterpret_cast<const void*>(address), length);
+}
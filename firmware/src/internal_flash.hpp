@@ -0,0 +1,38 @@
+/*******************************************************************************
+  Internal flash device
+
+  File Name:
+    internal_flash.hpp
+
+  Summary:
+    FlashDevice for the internal flash of the SAMD51, programmed by NVMCTRL.
+
+  Description:
+    Erase and program commands return immediately, so the next chunk can be
+    read from the SD card while NVMCTRL is busy. The commands are issued
+    through the NVMCTRL registers directly, since the Harmony NVMCTRL library
+    resides in flash.
+ *******************************************************************************/
+
+#ifndef INTERNAL_FLASH_HPP
+#define INTERNAL_FLASH_HPP
+
+#include "flash_device.hpp"
+#include "definitions.h"
+#include "ramfunc.hpp"
+
+class InternalFlash final : public FlashDevice
+{
+public:
+    static constexpr const std::uintptr_t Size = NVMCTRL_FLASH_SIZE;
+
+    std::uintptr_t GetBlockSize() const override { return NVMCTRL_FLASH_BLOCKSIZE; }
+    void Begin() override;
+    RAMFUNC void WaitReady() override;
+    RAMFUNC void EraseBlock(std::uintptr_t address) override;
+    RAMFUNC void WritePage(const std::uint32_t* data, std::uintptr_t address) override;
+    bool End() override;
+    void Read(std::uintptr_t address, void* buffer, std::size_t length) override;
+};
+
+#endif //INTERNAL_FLASH_HPP
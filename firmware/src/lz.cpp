@@ -0,0 +1,70 @@
+/*******************************************************************************
+  LZ decompressor
+
+  File Name:
+    lz.cpp
+
+  Summary:
+    Decoder for the byte oriented LZ77 format used in packed images.
+ *******************************************************************************/
+
+#include "lz.hpp"
+
+// Reads the extension bytes of a length field. Returns false if the input ends in the middle.
+RAMFUNC static bool ReadLength(const std::uint8_t*& input, const std::uint8_t* inputEnd, std::size_t& length)
+{
+    std::uint8_t value;
+    do {
+        if( input == inputEnd ) {
+            return false;
+        }
+        value = *input++;
+        length += value;
+    } while( value == 255 );
+    return true;
+}
+
+std::size_t LzDecompress(const std::uint8_t* input, std::size_t inputLength, std::uint8_t* output, std::size_t outputLength)
+{
+    auto inputEnd = input + inputLength;
+    auto outputBegin = output;
+    auto outputEnd = output + outputLength;
+
+    while( input < inputEnd ) {
+        auto token = *input++;
+
+        std::size_t literalLength = token >> 4;
+        if( literalLength == 15 && !ReadLength(input, inputEnd, literalLength) ) {
+            return 0;
+        }
+        if( literalLength > static_cast<std::size_t>(inputEnd - input) || literalLength > static_cast<std::size_t>(outputEnd - output) ) {
+            return 0;
+        }
+        for(std::size_t i = 0; i < literalLength; i++) {
+            *output++ = *input++;
+        }
+        if( input == inputEnd ) {
+            break;  // The last sequence has no match.
+        }
+
+        if( inputEnd - input < 2 ) {
+            return 0;
+        }
+        std::size_t offset = input[0] | (static_cast<std::size_t>(input[1]) << 8);
+        input += 2;
+        std::size_t matchLength = token & 0x0f;
+        if( matchLength == 15 && !ReadLength(input, inputEnd, matchLength) ) {
+            return 0;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if( offset == 0 || offset > static_cast<std::size_t>(output - outputBegin) || matchLength > static_cast<std::size_t>(outputEnd - output) ) {
+            return 0;
+        }
+        // The match may overlap the bytes it produces, so copy byte by byte.
+        auto source = output - offset;
+        for(std::size_t i = 0; i < matchLength; i++) {
+            *output++ = *source++;
+        }
+    }
+    return output - outputBegin;
+}
@@ -0,0 +1,40 @@
+/*******************************************************************************
+  LZ decompressor
+
+  File Name:
+    lz.hpp
+
+  Summary:
+    Decoder for the byte oriented LZ77 format used in packed images.
+
+  Description:
+    The format follows the LZ4 block format. The compressed data is a series
+    of sequences, each of which consists of
+
+    * A token byte. The upper 4 bits hold the literal length and the lower
+      4 bits hold the match length minus 4.
+    * If the literal length is 15, additional length bytes follow. Each is
+      added to the length, and a byte other than 255 terminates the list.
+    * The literal bytes.
+    * A 16 bit little endian match offset (1 to 65535), counted back from the
+      current output position.
+    * If the match length field is 15, additional length bytes as above.
+
+    The last sequence ends after its literals, i.e. it has neither an offset
+    nor a match. The compressor lives in tools/imagepack.
+ *******************************************************************************/
+
+#ifndef LZ_HPP
+#define LZ_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "ramfunc.hpp"
+
+static constexpr const std::size_t LZ_MIN_MATCH = 4;
+
+/* Decompresses input into output. Returns the number of bytes written to output,
+   or 0 if the input is malformed or does not fit into outputLength bytes. */
+RAMFUNC std::size_t LzDecompress(const std::uint8_t* input, std::size_t inputLength, std::uint8_t* output, std::size_t outputLength);
+
+#endif //LZ_HPP
@@ -53,7 +53,7 @@ void Reset_Handler(void)
 {
         uint32_t *pSrc, *pDest;
 
-        /* Initialize the relocate segment */
+        /* Initialize the relocate segment (.ramfunc code and .data) */
         pSrc = &_etext;
         pDest = &_srelocate;
 
@@ -0,0 +1,132 @@
+/*******************************************************************************
+  Image manifest
+
+  File Name:
+    manifest.cpp
+
+  Summary:
+    Parses the manifest which lists the images to program and their destinations.
+ *******************************************************************************/
+
+#include "manifest.hpp"
+#include <cstring>
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int HexDigitValue(char c)
+{
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+// Splits [begin, end) into whitespace separated fields. Returns the number of fields found, at most maxFields + 1.
+static std::size_t SplitFields(const char* begin, const char* end, const char** fields, std::size_t* lengths, std::size_t maxFields)
+{
+    std::size_t count = 0;
+    auto p = begin;
+    while( p < end ) {
+        while( p < end && IsSpace(*p) ) p++;
+        if( p == end ) {
+            break;
+        }
+        if( count == maxFields ) {
+            return count + 1;
+        }
+        fields[count] = p;
+        while( p < end && !IsSpace(*p) ) p++;
+        lengths[count] = p - fields[count];
+        count++;
+    }
+    return count;
+}
+
+static bool ParseLine(const char* begin, const char* end, Manifest& manifest)
+{
+    const char* fields[4];
+    std::size_t lengths[4];
+    auto fieldCount = SplitFields(begin, end, fields, lengths, 4);
+    if( fieldCount == 0 || *fields[0] == '#' ) {
+        return true;
+    }
+    if( fieldCount < 2 || fieldCount > 4 || manifest.count == MANIFEST_MAX_ENTRIES ) {
+        return false;
+    }
+
+    auto& entry = manifest.entries[manifest.count];
+    if( lengths[0] == 8 && std::strncmp(fields[0], "internal", 8) == 0 ) {
+        entry.destination = ManifestDestination::Internal;
+    }
+    else if( lengths[0] == 4 && std::strncmp(fields[0], "qspi", 4) == 0 ) {
+        entry.destination = ManifestDestination::Qspi;
+    }
+    else {
+        return false;
+    }
+
+    if( lengths[1] >= MANIFEST_MAX_PATH ) {
+        return false;
+    }
+    std::memcpy(entry.path, fields[1], lengths[1]);
+    entry.path[lengths[1]] = 0;
+
+    std::size_t field = 2;
+    entry.boot = field < fieldCount && lengths[field] == 4 && std::strncmp(fields[field], "boot", 4) == 0;
+    if( entry.boot ) {
+        if( entry.destination != ManifestDestination::Internal ) {
+            return false;
+        }
+        field++;
+    }
+
+    entry.hasDigest = field < fieldCount;
+    if( entry.hasDigest ) {
+        if( field + 1 != fieldCount || lengths[field] != MANIFEST_DIGEST_SIZE*2 ) {
+            return false;
+        }
+        for(std::size_t i = 0; i < MANIFEST_DIGEST_SIZE; i++) {
+            auto high = HexDigitValue(fields[field][i*2]);
+            auto low = HexDigitValue(fields[field][i*2 + 1]);
+            if( high < 0 || low < 0 ) {
+                return false;
+            }
+            entry.digest[i] = static_cast<std::uint8_t>((high << 4) | low);
+        }
+    }
+    manifest.count++;
+    return true;
+}
+
+bool ParseManifest(const char* text, std::size_t length, Manifest& manifest)
+{
+    manifest.count = 0;
+    auto end = text + length;
+    while( text < end ) {
+        auto lineEnd = static_cast<const char*>(std::memchr(text, '\n', end - text));
+        if( lineEnd == nullptr ) {
+            lineEnd = end;
+        }
+        if( !ParseLine(text, lineEnd, manifest) ) {
+            return false;
+        }
+        text = lineEnd == end ? end : lineEnd + 1;
+    }
+    return true;
+}
+
+bool HasOverlappingEntries(const Manifest& manifest, const ManifestBlockRange* ranges)
+{
+    for(std::size_t i = 0; i < manifest.count; i++) {
+        for(std::size_t j = i + 1; j < manifest.count; j++) {
+            if( manifest.entries[i].destination == manifest.entries[j].destination
+             && ranges[i].begin < ranges[j].end && ranges[j].begin < ranges[i].end ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+  Image manifest
+
+  File Name:
+    manifest.hpp
+
+  Summary:
+    Parses the manifest which lists the images to program and their destinations.
+
+  Description:
+    The manifest (manifest.txt on the SD card) is a text file with one image
+    per line:
+
+        <destination> <path> [boot] [<digest>]
+
+    * destination is `internal` for the internal flash or `qspi` for the
+      external QSPI flash.
+    * path is the packed image (see image_format.hpp), relative to the root
+      of the SD card.
+    * `boot` marks the application. It is allowed only for `internal`
+      images. The image must start at the application base address, and is
+      not started unless it has been verified (see LoadPackedImage()).
+      Other `internal` images, e.g. data placed behind the application, may
+      start anywhere in the internal flash above the loader.
+    * digest is optional. If given, it is the image digest as 64 hexadecimal
+      digits, as printed by tools/imagepack, and the image header must carry
+      the same digest.
+
+    Empty lines and lines starting with '#' are ignored. The images are
+    programmed in the order listed.
+
+    Images with the same destination must not touch a common erase block,
+    since programming one of them would erase a part of the other, and an
+    image which is already installed is skipped without being programmed
+    again. Such a manifest is rejected before anything is programmed.
+ *******************************************************************************/
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+static constexpr const std::size_t MANIFEST_MAX_ENTRIES = 8;
+static constexpr const std::size_t MANIFEST_MAX_PATH = 64;
+static constexpr const std::size_t MANIFEST_DIGEST_SIZE = 32;
+
+enum class ManifestDestination
+{
+    Internal,
+    Qspi,
+};
+
+struct ManifestEntry
+{
+    ManifestDestination destination;
+    bool boot;                       // The application, see LoadPackedImage()
+    bool hasDigest;
+    std::uint8_t digest[MANIFEST_DIGEST_SIZE];
+    char path[MANIFEST_MAX_PATH];    // NUL terminated
+};
+
+struct Manifest
+{
+    std::size_t count;
+    std::array<ManifestEntry, MANIFEST_MAX_ENTRIES> entries;
+};
+
+/* Erase blocks touched by the image of an entry, as the address range [begin, end) on its destination. */
+struct ManifestBlockRange
+{
+    std::uintptr_t begin;
+    std::uintptr_t end;
+};
+
+/* Parses the manifest text. Returns false on a malformed line or too many entries. */
+bool ParseManifest(const char* text, std::size_t length, Manifest& manifest);
+
+/* Checks whether two entries with the same destination touch a common erase block.
+   ranges holds the range of each entry of manifest, in the same order. */
+bool HasOverlappingEntries(const Manifest& manifest, const ManifestBlockRange* ranges);
+
+#endif //MANIFEST_HPP
@@ -0,0 +1,125 @@
+/*******************************************************************************
+  External QSPI flash device
+
+  File Name:
+    qspi_flash.cpp
+
+  Summary:
+    FlashDevice for the external QSPI flash of the Wio Terminal.
+ *******************************************************************************/
+
+#include "qspi_flash.hpp"
+#include "definitions.h"
+#include <cstring>
+
+static constexpr const std::uint8_t FLASH_WRITE_ENABLE = 0x06;
+static constexpr const std::uint8_t FLASH_READ_STATUS1 = 0x05;
+static constexpr const std::uint8_t FLASH_PAGE_PROGRAM = 0x02;
+static constexpr const std::uint8_t FLASH_SECTOR_ERASE = 0x20;
+static constexpr const std::uint8_t FLASH_STATUS1_BUSY = 0x01;
+
+void QspiFlash::SuspendXip(XipState& state)
+{
+    state.primask = __get_PRIMASK();
+    __disable_irq();
+    state.instrctrl = QSPI_REGS->QSPI_INSTRCTRL;
+    state.instrframe = QSPI_REGS->QSPI_INSTRFRAME;
+}
+
+void QspiFlash::ResumeXip(const XipState& state)
+{
+    QSPI_REGS->QSPI_INSTRCTRL = state.instrctrl;
+    QSPI_REGS->QSPI_INSTRFRAME = state.instrframe;
+    static_cast<void>(QSPI_REGS->QSPI_INSTRFRAME);
+    __DSB();
+    __ISB();
+    __set_PRIMASK(state.primask);
+}
+
+// Data, if any, is transferred through the memory mapped region at address.
+void QspiFlash::RunInstruction(std::uint8_t instruction, std::uint32_t frame, std::uintptr_t address, const std::uint8_t* txData, std::uint8_t* rxData, std::size_t length)
+{
+    QSPI_REGS->QSPI_INSTRCTRL = QSPI_INSTRCTRL_INSTR(instruction);
+    QSPI_REGS->QSPI_INSTRADDR = address;
+    QSPI_REGS->QSPI_INSTRFRAME = QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI | QSPI_INSTRFRAME_INSTREN_Msk | frame;
+    // Synchronize the APB and AHB accesses.
+    static_cast<void>(QSPI_REGS->QSPI_INSTRFRAME);
+
+    auto memory = reinterpret_cast<volatile std::uint8_t*>(MemoryBase + address);
+    for(std::size_t i = 0; i < length; i++) {
+        if( txData != nullptr ) {
+            memory[i] = txData[i];
+        }
+        else {
+            rxData[i] = memory[i];
+        }
+    }
+    __DSB();
+    __ISB();
+    QSPI_REGS->QSPI_CTRLA = QSPI_CTRLA_ENABLE_Msk | QSPI_CTRLA_LASTXFER_Msk;
+    while( (QSPI_REGS->QSPI_INTFLAG & QSPI_INTFLAG_INSTREND_Msk) == 0 );
+    QSPI_REGS->QSPI_INTFLAG = QSPI_INTFLAG_INSTREND_Msk;
+}
+
+void QspiFlash::WaitWhileBusy()
+{
+    std::uint8_t status;
+    do {
+        RunInstruction(FLASH_READ_STATUS1, QSPI_INSTRFRAME_DATAEN_Msk | QSPI_INSTRFRAME_TFRTYPE_READ, 0, nullptr, &status, 1);
+    } while( (status & FLASH_STATUS1_BUSY) != 0 );
+}
+
+void QspiFlash::WaitReady()
+{
+    // Every operation completes before returning, since the code runs from this flash.
+}
+
+void QspiFlash::EraseBlock(std::uintptr_t address)
+{
+    XipState state;
+    SuspendXip(state);
+    RunInstruction(FLASH_WRITE_ENABLE, 0, 0, nullptr, nullptr, 0);
+    RunInstruction(FLASH_SECTOR_ERASE, QSPI_INSTRFRAME_ADDREN_Msk | QSPI_INSTRFRAME_ADDRLEN_24BITS, address, nullptr, nullptr, 0);
+    WaitWhileBusy();
+    ResumeXip(state);
+}
+
+void QspiFlash::WritePage(const std::uint32_t* data, std::uintptr_t address)
+{
+    auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+    for(std::uintptr_t offset = 0; offset < FLASH_DEVICE_PAGE_SIZE; offset += ProgramPageSize) {
+        auto erased = true;
+        for(std::uintptr_t i = 0; i < ProgramPageSize/4 && erased; i++) {
+            erased = data[offset/4 + i] == 0xffffffffu;
+        }
+        if( erased ) {
+            continue;
+        }
+
+        XipState state;
+        SuspendXip(state);
+        RunInstruction(FLASH_WRITE_ENABLE, 0, 0, nullptr, nullptr, 0);
+        RunInstruction(FLASH_PAGE_PROGRAM, QSPI_INSTRFRAME_ADDREN_Msk | QSPI_INSTRFRAME_ADDRLEN_24BITS | QSPI_INSTRFRAME_DATAEN_Msk | QSPI_INSTRFRAME_TFRTYPE_WRITEMEMORY,
+                           address + offset, bytes + offset, nullptr, ProgramPageSize);
+        WaitWhileBusy();
+        ResumeXip(state);
+    }
+}
+
+bool QspiFlash::End()
+{
+    // Drop the stale lines of the programmed region from the cache.
+    auto enabled = (CMCC_REGS->CMCC_SR & CMCC_SR_CSTS_Msk) != 0;
+    CMCC_REGS->CMCC_CTRL = 0;
+    while( (CMCC_REGS->CMCC_SR & CMCC_SR_CSTS_Msk) != 0 );
+    CMCC_REGS->CMCC_MAINT0 = CMCC_MAINT0_INVALL_Msk;
+    if( enabled ) {
+        CMCC_REGS->CMCC_CTRL = CMCC_CTRL_CEN_Msk;
+    }
+    return true;
+}
+
+void QspiFlash::Read(std::uintptr_t address, void* buffer, std::size_t length)
+{
+    std::memcpy(buffer, reinterpret_cast<const void*>(MemoryBase + address), length);
+}
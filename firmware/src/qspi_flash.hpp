@@ -0,0 +1,67 @@
+/*******************************************************************************
+  External QSPI flash device
+
+  File Name:
+    qspi_flash.hpp
+
+  Summary:
+    FlashDevice for the external QSPI flash of the Wio Terminal.
+
+  Description:
+    The flash is a 4 MiB serial NOR flash with 4 KiB sectors and 256 byte
+    program pages, accessed through the QSPI peripheral. Addresses are
+    offsets from the start of the flash, which is mapped at MemoryBase.
+
+    The loader itself executes in place from this flash. While a serial
+    command is in progress the memory mapped region can not be read, so
+    every erase/program operation runs from RAM with interrupts disabled and
+    waits for the flash before returning. The instruction frame used for the
+    memory mapped reads is saved before and restored after each operation.
+    This assumes the memory mapped reads do not use the continuous read mode
+    of the flash.
+
+    Pages which are completely erased (all 0xff) are not programmed.
+ *******************************************************************************/
+
+#ifndef QSPI_FLASH_HPP
+#define QSPI_FLASH_HPP
+
+#include "flash_device.hpp"
+#include "ramfunc.hpp"
+
+class QspiFlash final : public FlashDevice
+{
+public:
+    static constexpr const std::uintptr_t MemoryBase = 0x04000000;
+    static constexpr const std::uintptr_t Size = 4 * 1024 * 1024;
+    static constexpr const std::uintptr_t SectorSize = 4096;
+    static constexpr const std::uintptr_t ProgramPageSize = 256;
+
+    std::uintptr_t GetBlockSize() const override { return SectorSize; }
+    void Begin() override {}
+    RAMFUNC void WaitReady() override;
+    RAMFUNC void EraseBlock(std::uintptr_t address) override;
+    RAMFUNC void WritePage(const std::uint32_t* data, std::uintptr_t address) override;
+    bool End() override;
+    void Read(std::uintptr_t address, void* buffer, std::size_t length) override;
+
+private:
+    // Keeps the memory mapped read configuration while serial commands are issued.
+    struct XipState
+    {
+        std::uint32_t primask;
+        std::uint32_t instrctrl;
+        std::uint32_t instrframe;
+    };
+
+    /* Disables interrupts and saves the memory mapped read configuration. */
+    RAMFUNC static void SuspendXip(XipState& state);
+    /* Restores the memory mapped read configuration and the interrupt mask. */
+    RAMFUNC static void ResumeXip(const XipState& state);
+    /* Runs one serial instruction, transferring length bytes from txData or into rxData. */
+    RAMFUNC static void RunInstruction(std::uint8_t instruction, std::uint32_t frame, std::uintptr_t address, const std::uint8_t* txData, std::uint8_t* rxData, std::size_t length);
+    /* Polls the status register until the flash has completed the operation. */
+    RAMFUNC static void WaitWhileBusy();
+};
+
+#endif //QSPI_FLASH_HPP
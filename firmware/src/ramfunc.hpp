@@ -0,0 +1,55 @@
+/*******************************************************************************
+  RAM function placement
+
+  File Name:
+    ramfunc.hpp
+
+  Summary:
+    Places functions into the .ramfunc section.
+
+  Description:
+    Functions marked with RAMFUNC are linked into the .ramfunc section, which
+    is part of the .relocate output section (see firmware/linker.ld) and copied
+    into RAM by Reset_Handler. They are called with long calls since RAM is out
+    of the branch range of the code running from flash.
+
+    The loader itself executes in place from the external QSPI flash (see
+    firmware/linker.ld), not from the internal flash. Erasing and programming
+    the internal flash therefore does not stall the loader's instruction
+    fetches, and the RAM placement matters for programming the QSPI flash,
+    during which the memory mapped region can not be read at all.
+
+    Loop distribution is disabled for them, as it may turn copy loops into
+    calls to memcpy()/memset() which reside in flash. Small helpers they call
+    are marked with RAMFUNC_INLINE, so that they never end up as out of line
+    copies in flash.
+
+    The flashing engine (FlashDevice::WaitReady()/EraseBlock()/WritePage() of
+    each device and FlashPageWriter::ProgramSlot()) and the kernels run per
+    byte of the image (CRC-32, LZ, SHA-256/512) are marked. The callers, i.e.
+    the loaders, FlashPageWriter::Write()/Commit(), the SYS_FS reads and the
+    signature verification, are intentionally left in flash: they only run
+    between device operations, and every QSPI flash operation finishes with
+    the interrupts disabled before returning.
+
+    The build checks the ELF with cmake/check_ramfunc.cmake: every function
+    listed in CMakeLists.txt must be in .ramfunc, and nothing in .ramfunc may
+    branch to or take the address of code or constants in flash. Calls
+    through the FlashDevice vtable can not be followed, so keep the list in
+    sync when adding or renaming a device or a function.
+
+    On the host (tools/imagepack) RAMFUNC expands to nothing.
+ *******************************************************************************/
+
+#ifndef RAMFUNC_HPP
+#define RAMFUNC_HPP
+
+#if defined(__arm__)
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call, optimize("no-tree-loop-distribute-patterns")))
+#define RAMFUNC_INLINE inline __attribute__((always_inline))
+#else
+#define RAMFUNC
+#define RAMFUNC_INLINE inline
+#endif
+
+#endif //RAMFUNC_HPP
@@ -0,0 +1,138 @@
+/*******************************************************************************
+  SHA-256
+
+  File Name:
+    sha256.cpp
+
+  Summary:
+    Incremental SHA-256 (FIPS 180-4).
+ *******************************************************************************/
+
+#include "sha256.hpp"
+#include <cstring>
+
+// Not const, so that the table is placed in .data and looked up from RAM like ProcessBlock().
+static std::uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static RAMFUNC_INLINE std::uint32_t RotateRight(std::uint32_t value, unsigned int count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+Sha256::Sha256()
+{
+    this->Reset();
+}
+
+void Sha256::Reset()
+{
+    static constexpr const std::uint32_t initialState[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    std::memcpy(this->state, initialState, sizeof(this->state));
+    this->totalLength = 0;
+    this->bufferLength = 0;
+}
+
+void Sha256::ProcessBlock(const std::uint8_t* block)
+{
+    std::uint32_t w[64];
+    for(int i = 0; i < 16; i++) {
+        w[i] = (static_cast<std::uint32_t>(block[i*4 + 0]) << 24)
+             | (static_cast<std::uint32_t>(block[i*4 + 1]) << 16)
+             | (static_cast<std::uint32_t>(block[i*4 + 2]) << 8)
+             | (static_cast<std::uint32_t>(block[i*4 + 3]) << 0);
+    }
+    for(int i = 16; i < 64; i++) {
+        auto s0 = RotateRight(w[i-15], 7) ^ RotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+        auto s1 = RotateRight(w[i-2], 17) ^ RotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    auto a = this->state[0];
+    auto b = this->state[1];
+    auto c = this->state[2];
+    auto d = this->state[3];
+    auto e = this->state[4];
+    auto f = this->state[5];
+    auto g = this->state[6];
+    auto h = this->state[7];
+    for(int i = 0; i < 64; i++) {
+        auto s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+        auto ch = (e & f) ^ (~e & g);
+        auto t1 = h + s1 + ch + roundConstants[i] + w[i];
+        auto s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+        auto maj = (a & b) ^ (a & c) ^ (b & c);
+        auto t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    this->state[0] += a;
+    this->state[1] += b;
+    this->state[2] += c;
+    this->state[3] += d;
+    this->state[4] += e;
+    this->state[5] += f;
+    this->state[6] += g;
+    this->state[7] += h;
+}
+
+void Sha256::Update(const void* data, std::size_t length)
+{
+    auto bytes = static_cast<const std::uint8_t*>(data);
+    this->totalLength += length;
+    if( this->bufferLength > 0 ) {
+        auto bytesToCopy = sizeof(this->buffer) - this->bufferLength;
+        if( bytesToCopy > length ) {
+            bytesToCopy = length;
+        }
+        std::memcpy(this->buffer + this->bufferLength, bytes, bytesToCopy);
+        this->bufferLength += bytesToCopy;
+        bytes += bytesToCopy;
+        length -= bytesToCopy;
+        if( this->bufferLength < sizeof(this->buffer) ) {
+            return;
+        }
+        this->ProcessBlock(this->buffer);
+        this->bufferLength = 0;
+    }
+    // Whole blocks are processed in place without going through the buffer.
+    for(; length >= sizeof(this->buffer); length -= sizeof(this->buffer), bytes += sizeof(this->buffer)) {
+        this->ProcessBlock(bytes);
+    }
+    std::memcpy(this->buffer, bytes, length);
+    this->bufferLength = length;
+}
+
+void Sha256::Final(std::uint8_t* digest)
+{
+    auto totalBits = this->totalLength * 8;
+    std::uint8_t padding[72] = {0x80};
+    auto paddingLength = (this->bufferLength < 56 ? 56 : 120) - this->bufferLength;
+    for(int i = 0; i < 8; i++) {
+        padding[paddingLength + i] = static_cast<std::uint8_t>(totalBits >> (56 - i*8));
+    }
+    this->Update(padding, paddingLength + 8);
+
+    for(int i = 0; i < 8; i++) {
+        digest[i*4 + 0] = static_cast<std::uint8_t>(this->state[i] >> 24);
+        digest[i*4 + 1] = static_cast<std::uint8_t>(this->state[i] >> 16);
+        digest[i*4 + 2] = static_cast<std::uint8_t>(this->state[i] >> 8);
+        digest[i*4 + 3] = static_cast<std::uint8_t>(this->state[i] >> 0);
+    }
+}
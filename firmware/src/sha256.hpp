@@ -0,0 +1,42 @@
+/*******************************************************************************
+  SHA-256
+
+  File Name:
+    sha256.hpp
+
+  Summary:
+    Incremental SHA-256 (FIPS 180-4).
+
+  Description:
+    Shared by the firmware and the host side packer.
+ *******************************************************************************/
+
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "ramfunc.hpp"
+
+class Sha256
+{
+public:
+    static constexpr const std::size_t DigestSize = 32;
+
+    Sha256();
+
+    void Reset();
+    void Update(const void* data, std::size_t length);
+    /* Writes the digest. The object must be Reset() before it is used again. */
+    void Final(std::uint8_t* digest);
+
+private:
+    RAMFUNC void ProcessBlock(const std::uint8_t* block);
+
+    std::uint32_t state[8];
+    std::uint64_t totalLength;
+    std::size_t bufferLength;
+    std::uint8_t buffer[64];
+};
+
+#endif //SHA256_HPP
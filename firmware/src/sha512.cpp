@@ -0,0 +1,141 @@
+/*******************************************************************************
+  SHA-512
+
+  File Name:
+    sha512.cpp
+
+  Summary:
+    Incremental SHA-512 (FIPS 180-4).
+ *******************************************************************************/
+
+#include "sha512.hpp"
+#include <cstring>
+
+// Not const, so that the table is placed in .data and looked up from RAM like ProcessBlock().
+static std::uint64_t roundConstants[80] = {
+    0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+    0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+    0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65, 0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+    0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+    0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df, 0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+    0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+    0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+    0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec, 0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+    0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+    0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817,
+};
+
+static RAMFUNC_INLINE std::uint64_t RotateRight(std::uint64_t value, unsigned int count)
+{
+    return (value >> count) | (value << (64 - count));
+}
+
+Sha512::Sha512()
+{
+    this->Reset();
+}
+
+void Sha512::Reset()
+{
+    static constexpr const std::uint64_t initialState[8] = {
+        0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+        0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179,
+    };
+    std::memcpy(this->state, initialState, sizeof(this->state));
+    this->totalLength = 0;
+    this->bufferLength = 0;
+}
+
+void Sha512::ProcessBlock(const std::uint8_t* block)
+{
+    std::uint64_t w[80];
+    for(int i = 0; i < 16; i++) {
+        w[i] = 0;
+        for(int j = 0; j < 8; j++) {
+            w[i] = (w[i] << 8) | block[i*8 + j];
+        }
+    }
+    for(int i = 16; i < 80; i++) {
+        auto s0 = RotateRight(w[i-15], 1) ^ RotateRight(w[i-15], 8) ^ (w[i-15] >> 7);
+        auto s1 = RotateRight(w[i-2], 19) ^ RotateRight(w[i-2], 61) ^ (w[i-2] >> 6);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    auto a = this->state[0];
+    auto b = this->state[1];
+    auto c = this->state[2];
+    auto d = this->state[3];
+    auto e = this->state[4];
+    auto f = this->state[5];
+    auto g = this->state[6];
+    auto h = this->state[7];
+    for(int i = 0; i < 80; i++) {
+        auto s1 = RotateRight(e, 14) ^ RotateRight(e, 18) ^ RotateRight(e, 41);
+        auto ch = (e & f) ^ (~e & g);
+        auto t1 = h + s1 + ch + roundConstants[i] + w[i];
+        auto s0 = RotateRight(a, 28) ^ RotateRight(a, 34) ^ RotateRight(a, 39);
+        auto maj = (a & b) ^ (a & c) ^ (b & c);
+        auto t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    this->state[0] += a;
+    this->state[1] += b;
+    this->state[2] += c;
+    this->state[3] += d;
+    this->state[4] += e;
+    this->state[5] += f;
+    this->state[6] += g;
+    this->state[7] += h;
+}
+
+void Sha512::Update(const void* data, std::size_t length)
+{
+    auto bytes = static_cast<const std::uint8_t*>(data);
+    this->totalLength += length;
+    if( this->bufferLength > 0 ) {
+        auto bytesToCopy = sizeof(this->buffer) - this->bufferLength;
+        if( bytesToCopy > length ) {
+            bytesToCopy = length;
+        }
+        std::memcpy(this->buffer + this->bufferLength, bytes, bytesToCopy);
+        this->bufferLength += bytesToCopy;
+        bytes += bytesToCopy;
+        length -= bytesToCopy;
+        if( this->bufferLength < sizeof(this->buffer) ) {
+            return;
+        }
+        this->ProcessBlock(this->buffer);
+        this->bufferLength = 0;
+    }
+    // Whole blocks are processed in place without going through the buffer.
+    for(; length >= sizeof(this->buffer); length -= sizeof(this->buffer), bytes += sizeof(this->buffer)) {
+        this->ProcessBlock(bytes);
+    }
+    std::memcpy(this->buffer, bytes, length);
+    this->bufferLength = length;
+}
+
+void Sha512::Final(std::uint8_t* digest)
+{
+    // The length field is 128 bits. Messages handled here are far below 2^61 bytes, so its upper half is zero.
+    auto totalBits = this->totalLength * 8;
+    std::uint8_t padding[144] = {0x80};
+    auto paddingLength = (this->bufferLength < 112 ? 112 : 240) - this->bufferLength;
+    for(int i = 0; i < 8; i++) {
+        padding[paddingLength + 8 + i] = static_cast<std::uint8_t>(totalBits >> (56 - i*8));
+    }
+    this->Update(padding, paddingLength + 16);
+
+    for(int i = 0; i < 8; i++) {
+        for(int j = 0; j < 8; j++) {
+            digest[i*8 + j] = static_cast<std::uint8_t>(this->state[i] >> (56 - j*8));
+        }
+    }
+}
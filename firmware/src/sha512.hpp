@@ -0,0 +1,43 @@
+/*******************************************************************************
+  SHA-512
+
+  File Name:
+    sha512.hpp
+
+  Summary:
+    Incremental SHA-512 (FIPS 180-4).
+
+  Description:
+    Used by the Ed25519 signature scheme. Shared by the firmware and the host
+    side packer.
+ *******************************************************************************/
+
+#ifndef SHA512_HPP
+#define SHA512_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "ramfunc.hpp"
+
+class Sha512
+{
+public:
+    static constexpr const std::size_t DigestSize = 64;
+
+    Sha512();
+
+    void Reset();
+    void Update(const void* data, std::size_t length);
+    /* Writes the digest. The object must be Reset() before it is used again. */
+    void Final(std::uint8_t* digest);
+
+private:
+    RAMFUNC void ProcessBlock(const std::uint8_t* block);
+
+    std::uint64_t state[8];
+    std::uint64_t totalLength;
+    std::size_t bufferLength;
+    std::uint8_t buffer[128];
+};
+
+#endif //SHA512_HPP
@@ -0,0 +1,35 @@
+/*******************************************************************************
+  Host stand-in for the Harmony definitions
+
+  File Name:
+    definitions.cpp
+
+  Summary:
+    SYS_FS file functions on top of stdio.
+ *******************************************************************************/
+
+#include "definitions.h"
+
+DWT_Type hostDwt;
+
+std::size_t SYS_FS_FileRead(SYS_FS_HANDLE handle, void* buffer, std::size_t length)
+{
+    return std::fread(buffer, 1, length, handle);
+}
+
+std::int32_t SYS_FS_FileSeek(SYS_FS_HANDLE handle, std::int32_t offset, SYS_FS_FILE_SEEK_CONTROL whence)
+{
+    if( std::fseek(handle, offset, whence) != 0 ) {
+        return -1;
+    }
+    return static_cast<std::int32_t>(std::ftell(handle));
+}
+
+std::int32_t SYS_FS_FileSize(SYS_FS_HANDLE handle)
+{
+    auto position = std::ftell(handle);
+    std::fseek(handle, 0, SEEK_END);
+    auto size = std::ftell(handle);
+    std::fseek(handle, position, SEEK_SET);
+    return static_cast<std::int32_t>(size);
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+  Host stand-in for the Harmony definitions
+
+  File Name:
+    definitions.h
+
+  Summary:
+    The subset of the Harmony definitions used by the loader sources.
+
+  Description:
+    The SYS_FS file functions are mapped onto stdio, the NVMCTRL geometry is
+    that of the SAMD51P19A, and DWT is a plain structure whose cycle counter
+    stays at zero. The flash itself is simulated by SimFlash.
+ *******************************************************************************/
+
+#ifndef DEFINITIONS_H
+#define DEFINITIONS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#define NVMCTRL_FLASH_SIZE      0x80000u
+#define NVMCTRL_FLASH_PAGESIZE  512u
+#define NVMCTRL_FLASH_BLOCKSIZE 8192u
+
+typedef std::FILE* SYS_FS_HANDLE;
+#define SYS_FS_HANDLE_INVALID   nullptr
+
+typedef enum
+{
+    SYS_FS_SEEK_SET = SEEK_SET,
+    SYS_FS_SEEK_CUR = SEEK_CUR,
+    SYS_FS_SEEK_END = SEEK_END,
+} SYS_FS_FILE_SEEK_CONTROL;
+
+std::size_t SYS_FS_FileRead(SYS_FS_HANDLE handle, void* buffer, std::size_t length);
+std::int32_t SYS_FS_FileSeek(SYS_FS_HANDLE handle, std::int32_t offset, SYS_FS_FILE_SEEK_CONTROL whence);
+std::int32_t SYS_FS_FileSize(SYS_FS_HANDLE handle);
+
+struct DWT_Type
+{
+    volatile std::uint32_t CTRL;
+    volatile std::uint32_t CYCCNT;
+};
+extern DWT_Type hostDwt;
+#define DWT (&hostDwt)
+
+#endif //DEFINITIONS_H
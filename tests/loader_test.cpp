@@ -0,0 +1,622 @@
+/*******************************************************************************
+  Loader host tests
+
+  File Name:
+    loader_test.cpp
+
+  Summary:
+    Loads images into simulated flash devices and checks the outcome.
+
+  Description:
+    The packed images are built with the writer of tools/imagepack
+    (image_writer.hpp), and individual chunks and header fields are tampered
+    with afterwards. The
+    devices are SimFlash instances with the block sizes of the internal flash
+    (8 KiB) and the external QSPI flash (4 KiB).
+
+    Built with IMAGE_PUBLIC_KEY (loader_signed_test), the images are signed
+    with TEST_SECRET_KEY and the signature checks are tested as well.
+ *******************************************************************************/
+
+#include "image_loader.hpp"
+#include "image_format.hpp"
+#include "manifest.hpp"
+#include "sim_flash.hpp"
+#include "sha256.hpp"
+#include "ed25519.hpp"
+#include "image_writer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+static int failureCount = 0;
+
+#define CHECK(condition) \
+    do { \
+        if( !(condition) ) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failureCount++; \
+        } \
+    } while(0)
+
+static constexpr const std::uintptr_t INTERNAL_SIZE = 0x80000;
+static constexpr const std::uintptr_t INTERNAL_BLOCK_SIZE = 8192;
+static constexpr const std::uintptr_t APP_BASE_ADDRESS = 0x4000;
+static constexpr const std::uintptr_t QSPI_SIZE = 0x100000;
+static constexpr const std::uintptr_t QSPI_BLOCK_SIZE = 4096;
+static constexpr const std::uintptr_t QSPI_BASE_ADDRESS = 0x10000;
+
+#if defined(IMAGE_PUBLIC_KEY)
+// Test 1 of RFC 8032, section 7.1. tests/CMakeLists.txt passes the matching public key.
+static const std::uint8_t TEST_SECRET_KEY[ED25519_SECRET_KEY_SIZE] = {
+    0x9d, 0x61, 0xb1, 0x9d, 0xef, 0xfd, 0x5a, 0x60, 0xba, 0x84, 0x4a, 0xf4, 0x92, 0xec, 0x2c, 0xc4,
+    0x44, 0x49, 0xc5, 0x69, 0x7b, 0x32, 0x69, 0x19, 0x70, 0x3b, 0xac, 0x03, 0x1c, 0xae, 0x7f, 0x60,
+};
+static const std::uint8_t TEST_PUBLIC_KEY[ED25519_PUBLIC_KEY_SIZE] = { IMAGE_PUBLIC_KEY };
+#endif
+
+static std::vector<std::uint8_t> MakeData(std::size_t length, std::uint32_t seed)
+{
+    std::vector<std::uint8_t> data(length);
+    for(std::size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245u + 12345u;
+        // Runs of repeated bytes, so that compression has something to find.
+        data[i] = (i & 0x40) != 0 ? static_cast<std::uint8_t>(i >> 8) : static_cast<std::uint8_t>(seed >> 16);
+    }
+    return data;
+}
+
+template<typename T>
+static void Append(std::vector<std::uint8_t>& output, const T& value)
+{
+    auto bytes = reinterpret_cast<const std::uint8_t*>(&value);
+    output.insert(output.end(), bytes, bytes + sizeof(value));
+}
+
+// Builds a packed image with the writer of tools/imagepack. Each segment is split at the chunk boundaries.
+// Without compress the chunks are stored as is, so that the test can tamper with their contents at known offsets.
+static std::vector<std::uint8_t> BuildPackedImage(const std::vector<Segment>& segments, bool compress)
+{
+    auto chunks = SplitIntoChunks(segments);
+    for(auto& chunk : chunks) {
+        PackChunk(chunk, compress);
+    }
+    PackedImageHeader header;
+#if defined(IMAGE_PUBLIC_KEY)
+    return SerializeImage(chunks, TEST_SECRET_KEY, header);
+#else
+    return SerializeImage(chunks, nullptr, header);
+#endif
+}
+
+// Offset of the data of the first chunk in a packed image.
+static constexpr const std::size_t FIRST_CHUNK_DATA_OFFSET = sizeof(PackedImageHeader) + sizeof(PackedChunkHeader);
+
+struct FileCloser
+{
+    void operator()(std::FILE* file) const { std::fclose(file); }
+};
+using File = std::unique_ptr<std::FILE, FileCloser>;
+
+static File OpenImage(const std::vector<std::uint8_t>& image)
+{
+    File file(std::tmpfile());
+    std::fwrite(image.data(), 1, image.size(), file.get());
+    std::rewind(file.get());
+    return file;
+}
+
+static bool LoadImage(const std::vector<std::uint8_t>& image, FlashPageWriter& writer, bool bootable, const std::uint8_t* expectedDigest = nullptr)
+{
+    auto file = OpenImage(image);
+    return LoadPackedImage(file.get(), writer, bootable, expectedDigest);
+}
+
+static bool IsImageInstalled(const std::vector<std::uint8_t>& image, FlashPageWriter& writer, const std::uint8_t* expectedDigest = nullptr)
+{
+    auto file = OpenImage(image);
+    return IsPackedImageInstalled(file.get(), writer, expectedDigest);
+}
+
+static bool ContentsEqual(const SimFlash& flash, const Segment& segment)
+{
+    return std::memcmp(flash.GetContents() + segment.address, segment.data.data(), segment.data.size()) == 0;
+}
+
+static void TestInternalFlashImage()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    Segment segment = { APP_BASE_ADDRESS, MakeData(20000, 1) };
+    auto image = BuildPackedImage({ segment }, true);
+
+    CHECK(!IsImageInstalled(image, writer));
+    CHECK(LoadImage(image, writer, true));
+    CHECK(ContentsEqual(flash, segment));
+    CHECK(flash.GetFaultCount() == 0);
+    CHECK(flash.GetEraseCount() == 3);
+    CHECK(flash.GetWriteCount() == (20000 + 511) / 512);
+    CHECK(writer.GetErasedBlockCount() == 3);
+    CHECK(writer.GetProgrammedPageCount() == (20000 + 511) / 512);
+    // Below the writer range and past the last erased block nothing is touched.
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS - 1] == 0x5a);
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS + 3*INTERNAL_BLOCK_SIZE] == 0x5a);
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS + 20000] == 0xff);
+    CHECK(IsImageInstalled(image, writer));
+}
+
+static void TestQspiFlashImage()
+{
+    // A sparse asset image. Only the blocks holding its contents are erased.
+    SimFlash flash(QSPI_SIZE, QSPI_BLOCK_SIZE);
+    FlashPageWriter writer(flash, QSPI_BASE_ADDRESS, QSPI_SIZE);
+    Segment first = { QSPI_BASE_ADDRESS, MakeData(3000, 2) };
+    Segment second = { QSPI_BASE_ADDRESS + 0x4000, MakeData(IMAGE_CHUNK_SIZE, 3) };
+    auto image = BuildPackedImage({ first, second }, true);
+
+    CHECK(LoadImage(image, writer, false));
+    CHECK(ContentsEqual(flash, first));
+    CHECK(ContentsEqual(flash, second));
+    CHECK(flash.GetFaultCount() == 0);
+    CHECK(flash.GetEraseCount() == 3);
+    CHECK(flash.GetWriteCount() == (3000 + 511) / 512 + IMAGE_CHUNK_SIZE / 512);
+    CHECK(flash.GetContents()[QSPI_BASE_ADDRESS + QSPI_BLOCK_SIZE] == 0x5a);
+    CHECK(IsImageInstalled(image, writer));
+}
+
+static void TestChangedImageIsNotInstalled()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(5000, 4) } }, false);
+    auto changed = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(5000, 5) } }, false);
+
+    CHECK(LoadImage(image, writer, true));
+    CHECK(IsImageInstalled(image, writer));
+    CHECK(!IsImageInstalled(changed, writer));
+    CHECK(LoadImage(changed, writer, true));
+    CHECK(IsImageInstalled(changed, writer));
+    CHECK(flash.GetFaultCount() == 0);
+}
+
+static void TestCorruptChunkIsRejected()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(5000, 6) } }, false);
+    image[FIRST_CHUNK_DATA_OFFSET + 100] ^= 0x01;
+
+    CHECK(!LoadImage(image, writer, true));
+    CHECK(flash.GetWriteCount() == 0);
+    CHECK(flash.GetFaultCount() == 0);
+}
+
+static void TestDigestMismatchIsRejected()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(5000, 7) } }, false);
+    std::uint8_t otherDigest[Sha256::DigestSize] = {};
+
+    CHECK(!LoadImage(image, writer, true, otherDigest));
+    CHECK(flash.GetEraseCount() == 0);
+    CHECK(flash.GetWriteCount() == 0);
+}
+
+static void TestApplicationMustStartAtBase()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    Segment vectors = { APP_BASE_ADDRESS, MakeData(1000, 10) };
+    Segment code = { APP_BASE_ADDRESS + 0x4000, MakeData(1000, 11) };
+
+    // Rejected before anything is erased.
+    CHECK(!LoadImage(BuildPackedImage({ code, vectors }, false), writer, true));
+    CHECK(!LoadImage(BuildPackedImage({ code }, false), writer, true));
+    CHECK(flash.GetEraseCount() == 0);
+    CHECK(flash.GetWriteCount() == 0);
+
+    // Images which are not bootable may start anywhere.
+    CHECK(LoadImage(BuildPackedImage({ code, vectors }, false), writer, false));
+    CHECK(ContentsEqual(flash, vectors));
+    CHECK(ContentsEqual(flash, code));
+}
+
+static void TestRejectedApplicationLeavesBasePageErased()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    Segment previous = { APP_BASE_ADDRESS, MakeData(3*INTERNAL_BLOCK_SIZE, 12) };
+    CHECK(LoadImage(BuildPackedImage({ previous }, false), writer, true));
+
+    // The first chunk is corrupt, so its block has not been erased in this session yet.
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(2*INTERNAL_BLOCK_SIZE, 13) } }, false);
+    image[FIRST_CHUNK_DATA_OFFSET + 100] ^= 0x01;
+    flash.ResetCounters();
+    CHECK(!LoadImage(image, writer, true));
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS] == 0xff);
+    CHECK(flash.GetEraseCount() == 1);
+    CHECK(flash.GetWriteCount() == 0);
+
+    // The second chunk is corrupt, after the first block has been erased and the rest of it programmed.
+    CHECK(LoadImage(BuildPackedImage({ previous }, false), writer, true));
+    image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(2*INTERNAL_BLOCK_SIZE, 13) } }, false);
+    image[FIRST_CHUNK_DATA_OFFSET + INTERNAL_BLOCK_SIZE + sizeof(PackedChunkHeader) + 100] ^= 0x01;
+    flash.ResetCounters();
+    CHECK(!LoadImage(image, writer, true));
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS] == 0xff);
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS + FlashPageWriter::PageSize] != 0xff);
+    CHECK(flash.GetEraseCount() == 1);
+    CHECK(flash.GetFaultCount() == 0);
+}
+
+static int idleCount = 0;
+
+static void TestIdleHandlerIsCalled()
+{
+    // The handler runs between the reads of every chunk, e.g. to keep the LCD initialization going.
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(3*IMAGE_CHUNK_SIZE, 14) } }, false);
+
+    SetImageLoadIdleHandler([]() { idleCount++; });
+    CHECK(LoadImage(image, writer, true));
+    CHECK(idleCount >= 1 + 3*2);
+    idleCount = 0;
+    CHECK(IsImageInstalled(image, writer));
+    CHECK(idleCount >= 1 + 3);
+    SetImageLoadIdleHandler(nullptr);
+    idleCount = 0;
+    CHECK(LoadImage(image, writer, true));
+    CHECK(idleCount == 0);
+}
+
+#if defined(IMAGE_PUBLIC_KEY)
+static void TestSignatureIsChecked()
+{
+    std::uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+    Ed25519GetPublicKey(publicKey, TEST_SECRET_KEY);
+    CHECK(std::memcmp(publicKey, TEST_PUBLIC_KEY, sizeof(publicKey)) == 0);
+
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    auto image = BuildPackedImage({ { APP_BASE_ADDRESS, MakeData(5000, 14) } }, false);
+    PackedImageHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+
+    // Rejected before anything is erased.
+    auto tampered = image;
+    tampered[offsetof(PackedImageHeader, signature)] ^= 0x01;
+    CHECK(!LoadImage(tampered, writer, true));
+    auto unsignedImage = image;
+    unsignedImage[offsetof(PackedImageHeader, flags)] &= ~IMAGE_FLAG_SIGNED;
+    CHECK(!LoadImage(unsignedImage, writer, true));
+    CHECK(flash.GetEraseCount() == 0);
+    CHECK(flash.GetWriteCount() == 0);
+
+    CHECK(LoadImage(image, writer, true));
+    CHECK(IsImageInstalled(image, writer));
+    CHECK(!IsImageInstalled(tampered, writer));
+    CHECK(GetImageVerificationCycles().hashedBytes == 5000 + 8);
+}
+#endif
+
+// A loadable segment of a test ELF. The contents are placed at paddr.
+struct TestElfSegment
+{
+    std::uint32_t paddr;
+    std::uint32_t vaddr;
+    std::uint32_t memsz;
+    std::vector<std::uint8_t> data;
+};
+
+// Builds an ELF32 ARM executable with one PT_LOAD program header per segment, in the order given.
+static std::vector<std::uint8_t> BuildElf(const std::vector<TestElfSegment>& segments)
+{
+    static constexpr const std::uint32_t HEADER_SIZE = 52;
+    static constexpr const std::uint32_t PROGRAM_HEADER_SIZE = 32;
+    std::vector<std::uint8_t> elf = { 0x7f, 'E', 'L', 'F', 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    Append(elf, static_cast<std::uint16_t>(2));     // type: executable
+    Append(elf, static_cast<std::uint16_t>(40));    // machine: ARM
+    std::uint32_t words[5] = { 1, 0, HEADER_SIZE, 0, 0 };   // version, entry, phoff, shoff, flags
+    Append(elf, words);
+    std::uint16_t halves[6] = { HEADER_SIZE, PROGRAM_HEADER_SIZE, static_cast<std::uint16_t>(segments.size()), 0, 0, 0 };
+    Append(elf, halves);
+
+    auto offset = static_cast<std::uint32_t>(HEADER_SIZE + PROGRAM_HEADER_SIZE * segments.size());
+    for(const auto& segment : segments) {
+        auto filesz = static_cast<std::uint32_t>(segment.data.size());
+        std::uint32_t programHeader[8] = { 1, offset, segment.vaddr, segment.paddr, filesz, std::max(segment.memsz, filesz), 5, 4 };
+        Append(elf, programHeader);
+        offset += filesz;
+    }
+    for(const auto& segment : segments) {
+        elf.insert(elf.end(), segment.data.begin(), segment.data.end());
+    }
+    return elf;
+}
+
+static bool LoadElf(const std::vector<std::uint8_t>& elf, FlashPageWriter& writer)
+{
+    auto file = OpenImage(elf);
+    return LoadElfImage(file.get(), writer);
+}
+
+static void TestSparseElf()
+{
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    // .text, .data loaded right after it but run from RAM, .bss without contents and a far segment.
+    // The program headers are not in address order.
+    TestElfSegment text = { APP_BASE_ADDRESS, APP_BASE_ADDRESS, 0, MakeData(3000, 17) };
+    TestElfSegment data = { APP_BASE_ADDRESS + 3000, 0x20000000, 0, MakeData(700, 18) };
+    TestElfSegment bss = { APP_BASE_ADDRESS + 3700, 0x20000300, 0x1000, {} };
+    TestElfSegment far = { 0x60100, 0x60100, 0, MakeData(1200, 19) };
+    CHECK(LoadElf(BuildElf({ far, text, bss, data }), writer));
+
+    CHECK(ContentsEqual(flash, { text.paddr, text.data }));
+    CHECK(ContentsEqual(flash, { data.paddr, data.data }));
+    CHECK(ContentsEqual(flash, { far.paddr, far.data }));
+    CHECK(flash.GetFaultCount() == 0);
+    // Only the blocks holding contents are erased. The gap in between is left as it was.
+    CHECK(flash.GetEraseCount() == 2);
+    CHECK(flash.GetWriteCount() == (3700 + 511) / 512 + 3);
+    CHECK(flash.GetContents()[APP_BASE_ADDRESS + INTERNAL_BLOCK_SIZE] == 0x5a);
+    CHECK(flash.GetContents()[0x60000] == 0xff);
+}
+
+static void TestBrokenElfIsRejected()
+{
+    TestElfSegment text = { APP_BASE_ADDRESS, APP_BASE_ADDRESS, 0, MakeData(3000, 20) };
+    TestElfSegment overlapping = { APP_BASE_ADDRESS + 2000, 0x20000000, 0, MakeData(700, 21) };
+    TestElfSegment belowBase = { APP_BASE_ADDRESS - 0x100, APP_BASE_ADDRESS - 0x100, 0, MakeData(700, 22) };
+    TestElfSegment pastEnd = { INTERNAL_SIZE - 0x100, INTERNAL_SIZE - 0x100, 0, MakeData(700, 23) };
+    std::vector<std::vector<std::uint8_t>> files = {
+        BuildElf({ text, overlapping }),
+        BuildElf({ text, belowBase }),
+        BuildElf({ pastEnd, text }),
+    };
+    // Not an executable.
+    auto relocatable = BuildElf({ text });
+    relocatable[16] = 1;
+    files.push_back(relocatable);
+
+    for(const auto& file : files) {
+        SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+        FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+        CHECK(!LoadElf(file, writer));
+        CHECK(flash.GetEraseCount() == 0);
+        CHECK(flash.GetWriteCount() == 0);
+    }
+}
+
+// UF2 blocks of a contiguous image, in address order. See https://github.com/microsoft/uf2
+static std::vector<std::vector<std::uint8_t>> BuildUf2Blocks(const Segment& segment)
+{
+    std::vector<std::vector<std::uint8_t>> blocks;
+    auto numBlocks = static_cast<std::uint32_t>((segment.data.size() + 255) / 256);
+    for(std::uint32_t blockNo = 0; blockNo < numBlocks; blockNo++) {
+        std::vector<std::uint8_t> block(512, 0);
+        std::uint32_t header[8] = { 0x0A324655, 0x9E5D5157, 0x00002000, segment.address + blockNo*256, 256, blockNo, numBlocks, 0x55114460 };
+        std::memcpy(block.data(), header, sizeof(header));
+        auto length = std::min<std::size_t>(256, segment.data.size() - blockNo*256);
+        std::memcpy(block.data() + sizeof(header), &segment.data[blockNo*256], length);
+        std::uint32_t magicEnd = 0x0AB16F30;
+        std::memcpy(block.data() + 508, &magicEnd, sizeof(magicEnd));
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+static bool LoadUf2(const std::vector<std::vector<std::uint8_t>>& blocks, FlashPageWriter& writer)
+{
+    std::vector<std::uint8_t> file;
+    for(const auto& block : blocks) {
+        file.insert(file.end(), block.begin(), block.end());
+    }
+    auto handle = OpenImage(file);
+    return LoadUf2Image(handle.get(), writer);
+}
+
+static void TestUf2BlockOrder()
+{
+    for(auto size : { 20000u, 60000u }) {
+        Segment segment = { APP_BASE_ADDRESS, MakeData(size, size) };
+        auto blocks = BuildUf2Blocks(segment);
+        for(int order = 0; order < 22; order++) {
+            auto shuffled = blocks;
+            if( order == 1 ) {
+                std::reverse(shuffled.begin(), shuffled.end());
+            }
+            else if( order >= 2 ) {
+                std::mt19937 random(order - 2);
+                std::shuffle(shuffled.begin(), shuffled.end(), random);
+            }
+            SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+            FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+            CHECK(LoadUf2(shuffled, writer));
+            CHECK(ContentsEqual(flash, segment));
+            CHECK(flash.GetFaultCount() == 0);
+            CHECK(flash.GetEraseCount() == (size + INTERNAL_BLOCK_SIZE - 1) / INTERNAL_BLOCK_SIZE);
+            CHECK(flash.GetWriteCount() == (size + 511) / 512);
+        }
+    }
+}
+
+static void TestBrokenUf2IsRejected()
+{
+    Segment segment = { APP_BASE_ADDRESS, MakeData(20000, 15) };
+    auto blocks = BuildUf2Blocks(segment);
+    std::vector<std::vector<std::vector<std::uint8_t>>> files;
+
+    auto missing = blocks;
+    missing.erase(missing.begin() + 40);
+    files.push_back(missing);
+    auto duplicate = blocks;
+    duplicate.push_back(blocks[40]);
+    files.push_back(duplicate);
+    // The same block number twice, with different addresses.
+    auto renumbered = blocks;
+    std::memcpy(renumbered[41].data() + 20, renumbered[40].data() + 20, 4);
+    files.push_back(renumbered);
+    auto badMagicStart = blocks;
+    badMagicStart[50][0] ^= 0x01;
+    files.push_back(badMagicStart);
+    auto badMagicEnd = blocks;
+    badMagicEnd[50][511] ^= 0x01;
+    files.push_back(badMagicEnd);
+    auto outOfRange = blocks;
+    std::uint32_t address = APP_BASE_ADDRESS - 256;
+    std::memcpy(outOfRange[70].data() + 12, &address, sizeof(address));
+    files.push_back(outOfRange);
+
+    for(const auto& file : files) {
+        SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+        FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+        CHECK(!LoadUf2(file, writer));
+        CHECK(flash.GetEraseCount() == 0);
+        CHECK(flash.GetWriteCount() == 0);
+        CHECK(flash.GetContents()[APP_BASE_ADDRESS] == 0x5a);
+    }
+}
+
+static void TestUf2ForeignBlocksAreSkipped()
+{
+    Segment segment = { APP_BASE_ADDRESS, MakeData(5000, 16) };
+    auto blocks = BuildUf2Blocks(segment);
+    // A block for another family, at an address the writer does not cover.
+    auto foreign = blocks[0];
+    std::uint32_t values[2] = { 0x00000000, 0x68ed2b88 };
+    std::memcpy(foreign.data() + 12, &values[0], sizeof(values[0]));
+    std::memcpy(foreign.data() + 28, &values[1], sizeof(values[1]));
+    blocks.insert(blocks.begin() + 3, foreign);
+
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    CHECK(LoadUf2(blocks, writer));
+    CHECK(ContentsEqual(flash, segment));
+}
+
+static void TestManifestParsing()
+{
+    static const char text[] =
+        "# destination path [boot] [digest]\n"
+        "internal app.img boot\r\n"
+        "\n"
+        "qspi  font.img\t28c18bf28168437c6e4dbe115c6be20cec0a939717d7ffaf9df12c30cb022cda\n"
+        "internal data.img 28c18bf28168437c6e4dbe115c6be20cec0a939717d7ffaf9df12c30cb022cda\n"
+        "internal app2.img boot 28c18bf28168437c6e4dbe115c6be20cec0a939717d7ffaf9df12c30cb022cda\n";
+    Manifest manifest;
+    CHECK(ParseManifest(text, sizeof(text) - 1, manifest));
+    CHECK(manifest.count == 4);
+    CHECK(manifest.entries[0].destination == ManifestDestination::Internal);
+    CHECK(std::strcmp(manifest.entries[0].path, "app.img") == 0);
+    CHECK(manifest.entries[0].boot);
+    CHECK(!manifest.entries[0].hasDigest);
+    CHECK(manifest.entries[1].destination == ManifestDestination::Qspi);
+    CHECK(std::strcmp(manifest.entries[1].path, "font.img") == 0);
+    CHECK(!manifest.entries[1].boot);
+    CHECK(manifest.entries[1].hasDigest);
+    CHECK(manifest.entries[1].digest[0] == 0x28 && manifest.entries[1].digest[31] == 0xda);
+    CHECK(manifest.entries[2].destination == ManifestDestination::Internal);
+    CHECK(!manifest.entries[2].boot);
+    CHECK(manifest.entries[2].hasDigest);
+    CHECK(manifest.entries[3].boot);
+    CHECK(manifest.entries[3].hasDigest);
+
+    static const char unknownDestination[] = "sram app.img\n";
+    CHECK(!ParseManifest(unknownDestination, sizeof(unknownDestination) - 1, manifest));
+    static const char shortDigest[] = "qspi font.img 28c18bf2\n";
+    CHECK(!ParseManifest(shortDigest, sizeof(shortDigest) - 1, manifest));
+    static const char bootQspi[] = "qspi font.img boot\n";
+    CHECK(!ParseManifest(bootQspi, sizeof(bootQspi) - 1, manifest));
+    static const char digestBeforeBoot[] = "internal app.img 28c18bf28168437c6e4dbe115c6be20cec0a939717d7ffaf9df12c30cb022cda boot\n";
+    CHECK(!ParseManifest(digestBeforeBoot, sizeof(digestBeforeBoot) - 1, manifest));
+}
+
+static void TestManifestDataInInternalFlash()
+{
+    // An internal image without `boot` is data behind the application, and is not tied to the application base.
+    static const char text[] = "internal app.img boot\ninternal data.img\n";
+    Manifest manifest;
+    CHECK(ParseManifest(text, sizeof(text) - 1, manifest));
+    CHECK(manifest.count == 2);
+
+    SimFlash flash(INTERNAL_SIZE, INTERNAL_BLOCK_SIZE);
+    FlashPageWriter writer(flash, APP_BASE_ADDRESS, INTERNAL_SIZE);
+    Segment application = { APP_BASE_ADDRESS, MakeData(5000, 15) };
+    Segment data = { APP_BASE_ADDRESS + 0x10000, MakeData(5000, 16) };
+    CHECK(!LoadImage(BuildPackedImage({ data }, false), writer, true));
+    CHECK(LoadImage(BuildPackedImage({ application }, false), writer, manifest.entries[0].boot));
+    CHECK(LoadImage(BuildPackedImage({ data }, false), writer, manifest.entries[1].boot));
+    CHECK(ContentsEqual(flash, application));
+    CHECK(ContentsEqual(flash, data));
+    CHECK(flash.GetFaultCount() == 0);
+}
+
+static void TestImageBlockRange()
+{
+    SimFlash flash(QSPI_SIZE, QSPI_BLOCK_SIZE);
+    FlashPageWriter writer(flash, QSPI_BASE_ADDRESS, QSPI_SIZE);
+    auto image = BuildPackedImage({ { QSPI_BASE_ADDRESS + 0x100, MakeData(3000, 8) }, { QSPI_BASE_ADDRESS + 0x6000, MakeData(10, 9) } }, false);
+    auto file = OpenImage(image);
+    std::uintptr_t begin, end;
+    CHECK(GetPackedImageBlockRange(file.get(), writer, begin, end));
+    CHECK(begin == QSPI_BASE_ADDRESS);
+    CHECK(end == QSPI_BASE_ADDRESS + 0x7000);
+
+    FlashPageWriter internalWriter(flash, APP_BASE_ADDRESS, QSPI_BASE_ADDRESS);
+    std::rewind(file.get());
+    CHECK(!GetPackedImageBlockRange(file.get(), internalWriter, begin, end));
+}
+
+static void TestManifestOverlap()
+{
+    static const char text[] =
+        "internal app.img\n"
+        "qspi font.img\n"
+        "qspi sound.img\n";
+    Manifest manifest;
+    CHECK(ParseManifest(text, sizeof(text) - 1, manifest));
+
+    // The application and the font use the same addresses, but on different devices.
+    ManifestBlockRange disjoint[] = { { 0x4000, 0x8000 }, { 0x4000, 0x6000 }, { 0x6000, 0x8000 } };
+    CHECK(!HasOverlappingEntries(manifest, disjoint));
+    ManifestBlockRange shared[] = { { 0x4000, 0x8000 }, { 0x4000, 0x6000 }, { 0x5000, 0x8000 } };
+    CHECK(HasOverlappingEntries(manifest, shared));
+}
+
+int main()
+{
+    TestInternalFlashImage();
+    TestQspiFlashImage();
+    TestChangedImageIsNotInstalled();
+    TestCorruptChunkIsRejected();
+    TestDigestMismatchIsRejected();
+    TestApplicationMustStartAtBase();
+    TestRejectedApplicationLeavesBasePageErased();
+    TestIdleHandlerIsCalled();
+#if defined(IMAGE_PUBLIC_KEY)
+    TestSignatureIsChecked();
+#endif
+    TestSparseElf();
+    TestBrokenElfIsRejected();
+    TestUf2BlockOrder();
+    TestBrokenUf2IsRejected();
+    TestUf2ForeignBlocksAreSkipped();
+    TestManifestParsing();
+    TestManifestDataInInternalFlash();
+    TestImageBlockRange();
+    TestManifestOverlap();
+
+    if( failureCount > 0 ) {
+        std::printf("%d checks failed\n", failureCount);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
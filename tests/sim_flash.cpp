@@ -0,0 +1,71 @@
+/*******************************************************************************
+  Simulated flash device
+
+  File Name:
+    sim_flash.cpp
+
+  Summary:
+    A FlashDevice in host memory, standing in for the internal or QSPI flash.
+ *******************************************************************************/
+
+#include "sim_flash.hpp"
+#include <cstring>
+
+SimFlash::SimFlash(std::size_t size, std::uintptr_t blockSize, std::uint8_t fill)
+    : contents(size, fill), blockSize(blockSize), eraseCount(0), writeCount(0), faultCount(0)
+{
+}
+
+void SimFlash::Begin()
+{
+}
+
+void SimFlash::WaitReady()
+{
+}
+
+void SimFlash::EraseBlock(std::uintptr_t address)
+{
+    if( (address & (this->blockSize - 1)) != 0 || address + this->blockSize > this->contents.size() ) {
+        this->faultCount++;
+        return;
+    }
+    std::memset(&this->contents[address], 0xff, this->blockSize);
+    this->eraseCount++;
+}
+
+void SimFlash::WritePage(const std::uint32_t* data, std::uintptr_t address)
+{
+    if( (address & (FLASH_DEVICE_PAGE_SIZE - 1)) != 0 || address + FLASH_DEVICE_PAGE_SIZE > this->contents.size() ) {
+        this->faultCount++;
+        return;
+    }
+    auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+    for(std::uintptr_t i = 0; i < FLASH_DEVICE_PAGE_SIZE; i++) {
+        if( this->contents[address + i] != 0xff ) {
+            this->faultCount++;
+            return;
+        }
+    }
+    for(std::uintptr_t i = 0; i < FLASH_DEVICE_PAGE_SIZE; i++) {
+        this->contents[address + i] &= bytes[i];
+    }
+    this->writeCount++;
+}
+
+bool SimFlash::End()
+{
+    return true;
+}
+
+void SimFlash::Read(std::uintptr_t address, void* buffer, std::size_t length)
+{
+    std::memcpy(buffer, &this->contents[address], length);
+}
+
+void SimFlash::ResetCounters()
+{
+    this->eraseCount = 0;
+    this->writeCount = 0;
+    this->faultCount = 0;
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+  Simulated flash device
+
+  File Name:
+    sim_flash.hpp
+
+  Summary:
+    A FlashDevice in host memory, standing in for the internal or QSPI flash.
+
+  Description:
+    Erasing sets a whole block to 0xff and programming can only clear bits,
+    like NOR flash. Programming a page whose bits are not all erased, or
+    erasing at an unaligned address, is recorded as a fault, since the real
+    devices would silently corrupt the contents.
+ *******************************************************************************/
+
+#ifndef SIM_FLASH_HPP
+#define SIM_FLASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "flash_device.hpp"
+
+class SimFlash final : public FlashDevice
+{
+public:
+    /* The initial contents are `fill`, so that untouched areas can be told apart from erased ones. */
+    SimFlash(std::size_t size, std::uintptr_t blockSize, std::uint8_t fill = 0x5a);
+
+    std::uintptr_t GetBlockSize() const override { return this->blockSize; }
+    void Begin() override;
+    void WaitReady() override;
+    void EraseBlock(std::uintptr_t address) override;
+    void WritePage(const std::uint32_t* data, std::uintptr_t address) override;
+    bool End() override;
+    void Read(std::uintptr_t address, void* buffer, std::size_t length) override;
+
+    const std::uint8_t* GetContents() const { return this->contents.data(); }
+    std::uint32_t GetEraseCount() const { return this->eraseCount; }
+    std::uint32_t GetWriteCount() const { return this->writeCount; }
+    std::uint32_t GetFaultCount() const { return this->faultCount; }
+    /* Clears the counters, keeping the contents. */
+    void ResetCounters();
+
+private:
+    std::vector<std::uint8_t> contents;
+    std::uintptr_t blockSize;
+    std::uint32_t eraseCount;
+    std::uint32_t writeCount;
+    std::uint32_t faultCount;
+};
+
+#endif //SIM_FLASH_HPP
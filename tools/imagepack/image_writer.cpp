@@ -0,0 +1,104 @@
+/*******************************************************************************
+  Packed image writer
+
+  File Name:
+    image_writer.cpp
+
+  Summary:
+    Builds packed images (see firmware/src/image_format.hpp) from segments.
+ *******************************************************************************/
+
+#include "image_writer.hpp"
+#include "crc32.hpp"
+#include "sha256.hpp"
+#include "ed25519.hpp"
+#include "lz.hpp"
+#include "lz_compress.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+template<typename T>
+static void Append(std::vector<std::uint8_t>& output, const T& value)
+{
+    auto bytes = reinterpret_cast<const std::uint8_t*>(&value);
+    output.insert(output.end(), bytes, bytes + sizeof(value));
+}
+
+std::vector<Chunk> SplitIntoChunks(const std::vector<Segment>& segments)
+{
+    std::vector<Chunk> chunks;
+    for(const auto& segment : segments) {
+        std::size_t offset = 0;
+        while( offset < segment.data.size() ) {
+            auto address = static_cast<std::uint32_t>(segment.address + offset);
+            auto size = std::min<std::size_t>(segment.data.size() - offset, IMAGE_CHUNK_SIZE - (address & (IMAGE_CHUNK_SIZE - 1)));
+            chunks.push_back(Chunk{address, segment.data.data() + offset, size, {}, 0});
+            offset += size;
+        }
+    }
+    return chunks;
+}
+
+void PackChunk(Chunk& chunk, bool compress)
+{
+    chunk.crc = Crc32Update(0, chunk.raw, chunk.rawSize);
+    if( !compress ) {
+        chunk.stored.assign(chunk.raw, chunk.raw + chunk.rawSize);
+        return;
+    }
+    auto compressed = LzCompress(chunk.raw, chunk.rawSize);
+
+    // Make sure that the firmware is able to restore the chunk.
+    std::vector<std::uint8_t> restored(chunk.rawSize);
+    auto restoredSize = LzDecompress(compressed.data(), compressed.size(), restored.data(), restored.size());
+    if( restoredSize != chunk.rawSize || !std::equal(restored.begin(), restored.end(), chunk.raw) ) {
+        throw std::runtime_error("compressed chunk does not round trip");
+    }
+
+    if( compressed.size() < chunk.rawSize ) {
+        chunk.stored = std::move(compressed);
+    }
+    else {
+        chunk.stored.assign(chunk.raw, chunk.raw + chunk.rawSize);
+    }
+}
+
+std::vector<std::uint8_t> SerializeImage(const std::vector<Chunk>& chunks, const std::uint8_t* secretKey, PackedImageHeader& header)
+{
+    header = {};
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.headerSize = sizeof(PackedImageHeader);
+    header.chunkCount = static_cast<std::uint32_t>(chunks.size());
+
+    Sha256 sha;
+    for(const auto& chunk : chunks) {
+        std::uint8_t placement[8];
+        for(int i = 0; i < 4; i++) {
+            placement[i + 0] = static_cast<std::uint8_t>(chunk.address >> (i*8));
+            placement[i + 4] = static_cast<std::uint8_t>(chunk.rawSize >> (i*8));
+        }
+        sha.Update(placement, sizeof(placement));
+        sha.Update(chunk.raw, chunk.rawSize);
+        header.totalSize += static_cast<std::uint32_t>(chunk.rawSize);
+    }
+    sha.Final(header.digest);
+    if( secretKey != nullptr ) {
+        Ed25519Sign(header.signature, header.digest, sizeof(header.digest), secretKey);
+        header.flags |= IMAGE_FLAG_SIGNED;
+    }
+
+    // The structures are stored as is; the host is assumed to be little endian like the target.
+    std::vector<std::uint8_t> image;
+    Append(image, header);
+    for(const auto& chunk : chunks) {
+        PackedChunkHeader chunkHeader = {};
+        chunkHeader.address = chunk.address;
+        chunkHeader.rawSize = static_cast<std::uint16_t>(chunk.rawSize);
+        chunkHeader.storedSize = static_cast<std::uint16_t>(chunk.stored.size());
+        chunkHeader.crc = chunk.crc;
+        Append(image, chunkHeader);
+        image.insert(image.end(), chunk.stored.begin(), chunk.stored.end());
+    }
+    return image;
+}
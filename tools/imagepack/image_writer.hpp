@@ -0,0 +1,55 @@
+/*******************************************************************************
+  Packed image writer
+
+  File Name:
+    image_writer.hpp
+
+  Summary:
+    Builds packed images (see firmware/src/image_format.hpp) from segments.
+
+  Description:
+    Used by imagepack and by the host tests in tests/, so that the tests load
+    exactly what the tool writes.
+
+    The segments are split into chunks with SplitIntoChunks(). Each chunk is
+    packed by PackChunk(), which is safe to call for different chunks from
+    several threads. SerializeImage() then computes the digest over the
+    packed chunks in file order and lays out the image.
+ *******************************************************************************/
+
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include "image_format.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* Contiguous contents placed at address. */
+struct Segment
+{
+    std::uint32_t address;
+    std::vector<std::uint8_t> data;
+};
+
+struct Chunk
+{
+    std::uint32_t address;
+    const std::uint8_t* raw;        // Points into the data of a Segment
+    std::size_t rawSize;
+    std::vector<std::uint8_t> stored;
+    std::uint32_t crc;
+};
+
+/* Splits the segments at the chunk boundaries. The chunks refer to the data of segments, which must outlive them. */
+std::vector<Chunk> SplitIntoChunks(const std::vector<Segment>& segments);
+
+/* Computes the CRC-32 of a chunk and its stored contents. If compress is set, the contents are LZ compressed
+   unless that does not make them smaller. Throws std::runtime_error if the compressed contents do not round trip. */
+void PackChunk(Chunk& chunk, bool compress = true);
+
+/* Builds the image from packed chunks and returns it. The header is stored to header.
+   The digest is signed if secretKey is given. */
+std::vector<std::uint8_t> SerializeImage(const std::vector<Chunk>& chunks, const std::uint8_t* secretKey, PackedImageHeader& header);
+
+#endif //IMAGE_WRITER_HPP
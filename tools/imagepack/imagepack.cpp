@@ -0,0 +1,282 @@
+/*******************************************************************************
+  Packed image generator
+
+  File Name:
+    imagepack.cpp
+
+  Summary:
+    Converts an application ELF (or a raw .bin) into the packed image format
+    described in firmware/src/image_format.hpp.
+
+  Description:
+    usage: imagepack [-j jobs] [-b base_address] [-k secret_key_file] input output
+           imagepack -g secret_key_file
+
+    An ELF input contributes its PT_LOAD segments with file contents, placed
+    at their load address. Any other input is treated as a raw binary placed
+    at base_address (0x4000 by default).
+
+    The segments are split into chunks along the flash erase blocks (see
+    image_writer.hpp). The chunks are compressed and checksummed on a pool
+    of worker threads, one
+    per host core unless -j is given. The image digest is computed afterwards
+    over the results in file order and printed, so that it can be copied into
+    manifest.txt (see firmware/src/manifest.hpp).
+
+    Images for the external QSPI flash are packed from a raw binary with
+    base_address set to the offset within the QSPI flash.
+
+    With -k the digest is signed with the Ed25519 secret key in the given
+    file, which holds the 32 byte key as 64 hexadecimal digits. -g creates
+    such a file from the system random source and prints the public key,
+    which is passed to the firmware build as IMAGE_PUBLIC_KEY. The file is
+    created readable by its owner only, and an existing file is never
+    overwritten.
+ *******************************************************************************/
+
+#include "image_format.hpp"
+#include "image_writer.hpp"
+#include "ed25519.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename T>
+static T ReadLittleEndian(const std::vector<std::uint8_t>& file, std::size_t offset)
+{
+    if( offset > file.size() || sizeof(T) > file.size() - offset ) {
+        throw std::runtime_error("truncated ELF file");
+    }
+    T value = 0;
+    for(std::size_t i = 0; i < sizeof(T); i++) {
+        value |= static_cast<T>(file[offset + i]) << (i*8);
+    }
+    return value;
+}
+
+static bool IsElf(const std::vector<std::uint8_t>& file)
+{
+    return file.size() >= 4 && file[0] == 0x7f && file[1] == 'E' && file[2] == 'L' && file[3] == 'F';
+}
+
+static std::vector<Segment> ReadElfSegments(const std::vector<std::uint8_t>& file)
+{
+    static constexpr const std::uint32_t PT_LOAD = 1;
+    if( file.size() < 52 || file[4] != 1 || file[5] != 1 ) {
+        throw std::runtime_error("only little endian ELF32 files are supported");
+    }
+    auto phoff = ReadLittleEndian<std::uint32_t>(file, 28);
+    auto phentsize = ReadLittleEndian<std::uint16_t>(file, 42);
+    auto phnum = ReadLittleEndian<std::uint16_t>(file, 44);
+
+    std::vector<Segment> segments;
+    for(std::size_t i = 0; i < phnum; i++) {
+        auto header = static_cast<std::size_t>(phoff) + i*phentsize;
+        auto type = ReadLittleEndian<std::uint32_t>(file, header + 0);
+        auto offset = ReadLittleEndian<std::uint32_t>(file, header + 4);
+        auto paddr = ReadLittleEndian<std::uint32_t>(file, header + 12);
+        auto filesz = ReadLittleEndian<std::uint32_t>(file, header + 16);
+        if( type != PT_LOAD || filesz == 0 ) {
+            continue;
+        }
+        if( offset > file.size() || filesz > file.size() - offset ) {
+            throw std::runtime_error("segment exceeds the ELF file");
+        }
+        segments.push_back(Segment{paddr, std::vector<std::uint8_t>(file.begin() + offset, file.begin() + offset + filesz)});
+    }
+    std::sort(segments.begin(), segments.end(), [](const Segment& lhs, const Segment& rhs) {
+        return lhs.address < rhs.address;
+    });
+    for(std::size_t i = 1; i < segments.size(); i++) {
+        if( static_cast<std::uint64_t>(segments[i-1].address) + segments[i-1].data.size() > segments[i].address ) {
+            throw std::runtime_error("overlapping segments");
+        }
+    }
+    return segments;
+}
+
+static void PackChunksInParallel(std::vector<Chunk>& chunks, unsigned int jobs)
+{
+    std::atomic<std::size_t> nextChunk(0);
+    std::atomic<bool> failed(false);
+    std::string error;
+    std::vector<std::thread> workers;
+    for(unsigned int i = 0; i < jobs; i++) {
+        workers.emplace_back([&]() {
+            for(auto index = nextChunk++; index < chunks.size() && !failed; index = nextChunk++) {
+                try {
+                    PackChunk(chunks[index]);
+                }
+                catch(const std::exception& e) {
+                    if( !failed.exchange(true) ) {
+                        error = e.what();
+                    }
+                }
+            }
+        });
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    if( failed ) {
+        throw std::runtime_error(error);
+    }
+}
+
+static std::string ToHex(const std::uint8_t* data, std::size_t length)
+{
+    std::string text;
+    for(std::size_t i = 0; i < length; i++) {
+        char digits[3];
+        std::snprintf(digits, sizeof(digits), "%02x", data[i]);
+        text += digits;
+    }
+    return text;
+}
+
+static void ReadSecretKey(const std::string& path, std::uint8_t* secretKey)
+{
+    std::ifstream stream(path);
+    std::string text;
+    if( !(stream >> text) || text.size() != ED25519_SECRET_KEY_SIZE*2 || text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos ) {
+        throw std::runtime_error("failed to read the secret key from " + path);
+    }
+    for(std::size_t i = 0; i < ED25519_SECRET_KEY_SIZE; i++) {
+        secretKey[i] = static_cast<std::uint8_t>(std::stoul(text.substr(i*2, 2), nullptr, 16));
+    }
+}
+
+static void GenerateSecretKey(const std::string& path)
+{
+    std::random_device random;
+    std::uint8_t secretKey[ED25519_SECRET_KEY_SIZE];
+    for(auto& value : secretKey) {
+        value = static_cast<std::uint8_t>(random());
+    }
+    // Created exclusively, so that neither an existing key nor a file planted by another user is written to.
+    auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if( fd < 0 ) {
+        throw std::runtime_error("failed to create " + path + ": " + std::strerror(errno));
+    }
+    auto text = ToHex(secretKey, sizeof(secretKey)) + "\n";
+    auto written = write(fd, text.data(), text.size());
+    if( close(fd) != 0 || written != static_cast<ssize_t>(text.size()) ) {
+        unlink(path.c_str());
+        throw std::runtime_error("failed to write " + path);
+    }
+    std::uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+    Ed25519GetPublicKey(publicKey, secretKey);
+    std::printf("public key: %s\n", ToHex(publicKey, sizeof(publicKey)).c_str());
+}
+
+// Writes the image and returns its header. The digest is signed if secretKey is given.
+static PackedImageHeader WriteImage(const std::string& path, const std::vector<Chunk>& chunks, const std::uint8_t* secretKey)
+{
+    PackedImageHeader header;
+    auto image = SerializeImage(chunks, secretKey, header);
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(image.data()), image.size());
+    if( !stream ) {
+        throw std::runtime_error("failed to write " + path);
+    }
+    return header;
+}
+
+static void Usage()
+{
+    std::fprintf(stderr, "usage: imagepack [-j jobs] [-b base_address] [-k secret_key_file] input output\n");
+    std::fprintf(stderr, "       imagepack -g secret_key_file\n");
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::uint32_t baseAddress = 0x4000;
+    std::string secretKeyPath;
+    std::string generateKeyPath;
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if( arg == "-k" && i + 1 < argc ) {
+            secretKeyPath = argv[++i];
+        }
+        else if( arg == "-g" && i + 1 < argc ) {
+            generateKeyPath = argv[++i];
+        }
+        else if( (arg == "-j" || arg == "-b") && i + 1 < argc ) {
+            auto value = std::strtoul(argv[++i], nullptr, 0);
+            if( arg == "-j" ) {
+                jobs = std::max(1ul, value);
+            }
+            else {
+                baseAddress = static_cast<std::uint32_t>(value);
+            }
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+    if( !generateKeyPath.empty() && paths.empty() ) {
+        try {
+            GenerateSecretKey(generateKeyPath);
+        }
+        catch(const std::exception& e) {
+            std::fprintf(stderr, "imagepack: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+    if( paths.size() != 2 || !generateKeyPath.empty() ) {
+        Usage();
+        return 1;
+    }
+
+    try {
+        std::uint8_t secretKey[ED25519_SECRET_KEY_SIZE];
+        if( !secretKeyPath.empty() ) {
+            ReadSecretKey(secretKeyPath, secretKey);
+        }
+
+        std::ifstream stream(paths[0], std::ios::binary);
+        if( !stream ) {
+            throw std::runtime_error("failed to open " + paths[0]);
+        }
+        std::vector<std::uint8_t> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        auto segments = IsElf(file) ? ReadElfSegments(file) : std::vector<Segment>{Segment{baseAddress, file}};
+        auto chunks = SplitIntoChunks(segments);
+        if( chunks.empty() ) {
+            throw std::runtime_error("no contents in " + paths[0]);
+        }
+        PackChunksInParallel(chunks, jobs);
+        auto header = WriteImage(paths[1], chunks, secretKeyPath.empty() ? nullptr : secretKey);
+
+        std::size_t rawSize = 0;
+        std::size_t storedSize = 0;
+        for(const auto& chunk : chunks) {
+            rawSize += chunk.rawSize;
+            storedSize += chunk.stored.size();
+        }
+        std::printf("%s: %zu segments, %zu chunks, %zu -> %zu bytes\n", paths[1].c_str(), segments.size(), chunks.size(), rawSize, storedSize);
+        // The digest in the form used by manifest.txt.
+        std::printf("digest: %s%s\n", ToHex(header.digest, sizeof(header.digest)).c_str(), secretKeyPath.empty() ? "" : " (signed)");
+    }
+    catch(const std::exception& e) {
+        std::fprintf(stderr, "imagepack: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
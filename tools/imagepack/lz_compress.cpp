@@ -0,0 +1,85 @@
+/*******************************************************************************
+  LZ compressor
+
+  File Name:
+    lz_compress.cpp
+
+  Summary:
+    Compressor for the LZ format decoded by firmware/src/lz.cpp.
+ *******************************************************************************/
+
+#include "lz_compress.hpp"
+#include "lz.hpp"
+#include <cstring>
+
+static constexpr const std::size_t HASH_BITS = 12;
+static constexpr const std::size_t MAX_OFFSET = 65535;
+
+static std::uint32_t HashAt(const std::uint8_t* p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void WriteLength(std::vector<std::uint8_t>& output, std::size_t length)
+{
+    for(; length >= 255; length -= 255) {
+        output.push_back(255);
+    }
+    output.push_back(static_cast<std::uint8_t>(length));
+}
+
+static void WriteSequence(std::vector<std::uint8_t>& output, const std::uint8_t* literals, std::size_t literalLength, std::size_t offset, std::size_t matchLength)
+{
+    auto matchCode = matchLength - LZ_MIN_MATCH;
+    auto token = static_cast<std::uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+    if( matchLength > 0 ) {
+        token |= static_cast<std::uint8_t>(matchCode < 15 ? matchCode : 15);
+    }
+    output.push_back(token);
+    if( literalLength >= 15 ) {
+        WriteLength(output, literalLength - 15);
+    }
+    output.insert(output.end(), literals, literals + literalLength);
+    if( matchLength == 0 ) {
+        return;     // Last sequence
+    }
+    output.push_back(static_cast<std::uint8_t>(offset & 0xff));
+    output.push_back(static_cast<std::uint8_t>(offset >> 8));
+    if( matchCode >= 15 ) {
+        WriteLength(output, matchCode - 15);
+    }
+}
+
+std::vector<std::uint8_t> LzCompress(const std::uint8_t* input, std::size_t inputLength)
+{
+    std::vector<std::uint8_t> output;
+    std::vector<std::ptrdiff_t> table(static_cast<std::size_t>(1) << HASH_BITS, -1);
+
+    std::size_t anchor = 0;
+    std::size_t position = 0;
+    while( position + LZ_MIN_MATCH <= inputLength ) {
+        auto hash = HashAt(input + position);
+        auto candidate = table[hash];
+        table[hash] = position;
+        if( candidate < 0 || position - candidate > MAX_OFFSET || std::memcmp(input + candidate, input + position, LZ_MIN_MATCH) != 0 ) {
+            position++;
+            continue;
+        }
+
+        auto matchLength = LZ_MIN_MATCH;
+        while( position + matchLength < inputLength && input[candidate + matchLength] == input[position + matchLength] ) {
+            matchLength++;
+        }
+        WriteSequence(output, input + anchor, position - anchor, position - candidate, matchLength);
+        // Register the positions inside the match so that later data can refer to them.
+        for(auto p = position + 1; p < position + matchLength && p + LZ_MIN_MATCH <= inputLength; p++) {
+            table[HashAt(input + p)] = p;
+        }
+        position += matchLength;
+        anchor = position;
+    }
+    WriteSequence(output, input + anchor, inputLength - anchor, 0, 0);
+    return output;
+}
@@ -0,0 +1,21 @@
+/*******************************************************************************
+  LZ compressor
+
+  File Name:
+    lz_compress.hpp
+
+  Summary:
+    Compressor for the LZ format decoded by firmware/src/lz.cpp.
+ *******************************************************************************/
+
+#ifndef LZ_COMPRESS_HPP
+#define LZ_COMPRESS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* Compresses input with greedy hash based match finding. */
+std::vector<std::uint8_t> LzCompress(const std::uint8_t* input, std::size_t inputLength);
+
+#endif //LZ_COMPRESS_HPP